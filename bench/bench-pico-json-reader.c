@@ -0,0 +1,587 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "pico-json-reader.h"
+
+#define BENCH_MIN_NS 200000000ull                            // time each benchmark runs for at least
+#define BENCH_LARGE_LENGTH (1 << 20)
+#define BENCH_HUGE_LENGTH (8 << 20)
+#define BENCH_JSMN_MAX_LENGTH (2 << 20)                      // jsmn is quadratic on wide containers
+
+typedef void (*bench_fn) (void *context);
+
+typedef struct bench_doc {
+    const char *name;
+    char *json;
+    size_t length;
+    json_token_t *tokens;
+    int token_count;
+} bench_doc_t;
+
+
+static volatile int64_t bench_sink;                          // keeps results alive
+
+
+static uint64_t bench_now_ns (void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+
+/**
+ * Run fn repeatedly for at least BENCH_MIN_NS and print the time per call.
+ * @param name Name of the benchmark.
+ * @param bytes Bytes processed per call or 0 to skip the throughput column.
+ * @param fn Function to benchmark.
+ * @param context Passed to fn.
+ * @return Nanoseconds per call.
+ */
+static double bench_run (const char *name, size_t bytes, bench_fn fn, void *context) {
+  uint64_t iterations = 1, elapsed;
+  fn(context);
+  for (;;) {
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < iterations; i++) fn(context);
+    elapsed = bench_now_ns() - start;
+    if (elapsed >= BENCH_MIN_NS) break;
+    iterations = elapsed < BENCH_MIN_NS / 64 ? iterations * 16 : iterations * 2;
+  }
+  double ns = (double)elapsed / iterations;
+  if (bytes) printf("%-48s %14.1f ns/op %10.1f MB/s\n", name, ns, bytes / ns * 1000.0);
+  else printf("%-48s %14.1f ns/op\n", name, ns);
+  return ns;
+}
+
+
+static char * bench_read (const char *name, size_t *length) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", JSON_CORPUS_DIR, name);
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    fprintf(stderr, "cannot open %s\n", path);
+    exit(1);
+  }
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  char *buffer = malloc(size + 1);
+  if (buffer == NULL || fread(buffer, 1, size, file) != (size_t)size) exit(1);
+  fclose(file);
+  buffer[size] = '\0';
+  *length = size;
+  return buffer;
+}
+
+
+// fixed seed so every run measures the same documents
+static uint32_t bench_seed = 12345;
+
+static uint32_t bench_random (void) {
+  bench_seed = bench_seed * 1103515245u + 12345u;
+  return bench_seed >> 8;
+}
+
+
+// generate a root array of sensor records of about length bytes
+static char * bench_generate (size_t length, size_t *out_length) {
+  static const char *types[] = { "temperature", "humidity", "pressure", "soil" };
+  char *json = malloc(length + 512);
+  size_t used = 0;
+  bench_seed = 12345;
+  json[used++] = '[';
+  for (int i = 0; used < length; i++) {
+    uint32_t r = bench_random();
+    used += sprintf(json + used,
+      "%s{\"id\":%d,\"type\":\"%s\",\"value\":%u.%02u,\"ok\":%s,\"name\":\"sensor \\\"%u\\\"\",\"samples\":[%u,%u,%u]}",
+      i ? "," : "", i, types[r & 3], r % 1000, r % 100, r & 4 ? "true" : "false", r % 97,
+      bench_random() % 4096, bench_random() % 4096, bench_random() % 4096);
+  }
+  json[used++] = ']';
+  json[used] = '\0';
+  *out_length = used;
+  return json;
+}
+
+
+static void bench_doc_tokens (bench_doc_t *doc) {
+  jsmn_parser parser;
+  doc->token_count = json_parse_tokens_structural(&parser, doc->json, doc->length, &doc->tokens);
+  if (doc->token_count <= 0) {
+    fprintf(stderr, "%s failed to parse: %d\n", doc->name, doc->token_count);
+    exit(1);
+  }
+}
+
+
+static void bench_parse_jsmn (void *context) {
+  bench_doc_t *doc = context;
+  jsmn_parser parser;
+  json_token_t *tokens = NULL;
+  bench_sink += json_parse_tokens(&parser, doc->json, &tokens);
+  json_free(tokens);
+}
+
+
+static void bench_parse_structural (void *context) {
+  bench_doc_t *doc = context;
+  jsmn_parser parser;
+  json_token_t *tokens = NULL;
+  bench_sink += json_parse_tokens_structural(&parser, doc->json, doc->length, &tokens);
+  json_free(tokens);
+}
+
+
+typedef struct bench_select {
+    bench_doc_t *doc;
+    json_path_t paths[3];
+    int path_count;
+} bench_select_t;
+
+static void bench_parse_selected (void *context) {
+  bench_select_t *select = context;
+  json_token_t *tokens = NULL;
+  bench_sink += json_parse_tokens_selected(select->paths, select->path_count, select->doc->json, select->doc->length, &tokens);
+  json_free(tokens);
+}
+
+
+typedef struct bench_getter {
+    bench_doc_t *doc;
+    char *key;
+} bench_getter_t;
+
+static void bench_get_s (void *context) {
+  bench_getter_t *g = context;
+  char *value = NULL;
+  bench_sink += json_get_value_s(g->key, &value, g->doc->json, g->doc->tokens, 0);
+  json_free(value);
+}
+
+static void bench_get_sv (void *context) {
+  bench_getter_t *g = context;
+  json_string_view_t value;
+  bench_sink += json_get_value_sv(g->key, &value, g->doc->json, g->doc->tokens, 0) + value.len;
+}
+
+static void bench_get_sn (void *context) {
+  bench_getter_t *g = context;
+  char buffer[64];
+  size_t length;
+  bench_sink += json_get_value_sn(g->key, buffer, sizeof(buffer), &length, g->doc->json, g->doc->tokens, 0) + length;
+}
+
+static void bench_get_unescaped (void *context) {
+  bench_getter_t *g = context;
+  char buffer[64];
+  size_t length;
+  bench_sink += json_get_value_unescaped(g->key, buffer, sizeof(buffer), &length, g->doc->json, g->doc->tokens, 0) + length;
+}
+
+static void bench_get_i (void *context) {
+  bench_getter_t *g = context;
+  int value = 0;
+  bench_sink += json_get_value_i(g->key, &value, g->doc->json, g->doc->tokens, 0) + value;
+}
+
+static void bench_get_i64 (void *context) {
+  bench_getter_t *g = context;
+  int64_t value = 0;
+  bench_sink += json_get_value_i64(g->key, &value, g->doc->json, g->doc->tokens, 0) + value;
+}
+
+static void bench_get_u64 (void *context) {
+  bench_getter_t *g = context;
+  uint64_t value = 0;
+  bench_sink += json_get_value_u64(g->key, &value, g->doc->json, g->doc->tokens, 0) + value;
+}
+
+static void bench_get_u32 (void *context) {
+  bench_getter_t *g = context;
+  uint32_t value = 0;
+  bench_sink += json_get_value_u32(g->key, &value, g->doc->json, g->doc->tokens, 0) + value;
+}
+
+static void bench_get_d (void *context) {
+  bench_getter_t *g = context;
+  double value = 0;
+  bench_sink += json_get_value_d(g->key, &value, g->doc->json, g->doc->tokens, 0) + (int64_t)value;
+}
+
+static void bench_get_f (void *context) {
+  bench_getter_t *g = context;
+  float value = 0;
+  bench_sink += json_get_value_f(g->key, &value, g->doc->json, g->doc->tokens, 0) + (int64_t)value;
+}
+
+static void bench_get_fixed (void *context) {
+  bench_getter_t *g = context;
+  int64_t value = 0;
+  bench_sink += json_get_value_fixed(g->key, &value, 3, g->doc->json, g->doc->tokens, 0) + value;
+}
+
+static void bench_get_b (void *context) {
+  bench_getter_t *g = context;
+  bool value = false;
+  bench_sink += json_get_value_b(g->key, &value, g->doc->json, g->doc->tokens, 0) + value;
+}
+
+static void bench_get_array_i32 (void *context) {
+  bench_getter_t *g = context;
+  static int32_t values[4096];
+  size_t count = 0;
+  bench_sink += json_get_array_i32(g->key, values, 4096, &count, g->doc->json, g->doc->tokens, 0) + count;
+}
+
+static void bench_key_index (void *context) {
+  bench_getter_t *g = context;
+  bench_sink += json_key_index(g->doc->tokens, 0, g->key, g->doc->json);
+}
+
+static void bench_value_index (void *context) {
+  bench_getter_t *g = context;
+  bench_sink += json_value_index(g->doc->tokens, 0, g->key, g->doc->json);
+}
+
+static void bench_scan_value (void *context) {
+  bench_getter_t *g = context;
+  json_string_view_t value;
+  bench_sink += json_scan_value(g->doc->json, g->doc->length, g->key, &value);
+}
+
+
+static void bench_getters (bench_doc_t *doc) {
+  static const struct {
+      const char *name;
+      bench_fn fn;
+      char *key;
+  } getters[] = {
+    { "json_get_value_s", bench_get_s, "device.name" },
+    { "json_get_value_sv", bench_get_sv, "device.name" },
+    { "json_get_value_sn", bench_get_sn, "device.name" },
+    { "json_get_value_unescaped", bench_get_unescaped, "device.name" },
+    { "json_get_value_i", bench_get_i, "mqtt.port" },
+    { "json_get_value_i64", bench_get_i64, "mqtt.port" },
+    { "json_get_value_u64", bench_get_u64, "mqtt.port" },
+    { "json_get_value_u32", bench_get_u32, "mqtt.port" },
+    { "json_get_value_d", bench_get_d, "thresholds.soil.max" },
+    { "json_get_value_f", bench_get_f, "thresholds.soil.max" },
+    { "json_get_value_fixed", bench_get_fixed, "thresholds.soil.max" },
+    { "json_get_value_b", bench_get_b, "device.enabled" },
+    { "json_scan_value", bench_scan_value, "thresholds.soil.max" }
+  };
+  char name[64];
+  printf("\ngetters on %s\n", doc->name);
+  for (size_t i = 0; i < sizeof(getters) / sizeof(getters[0]); i++) {
+    bench_getter_t getter = { doc, getters[i].key };
+    snprintf(name, sizeof(name), "%s(%s)", getters[i].name, getters[i].key);
+    bench_run(name, 0, getters[i].fn, &getter);
+  }
+}
+
+
+static void bench_depths (bench_doc_t *doc) {
+  char key[256];
+  char name[64];
+  printf("\njson_key_index on %s\n", doc->name);
+  for (int depth = 1; depth <= 24; depth *= 2) {
+    size_t used = 0;
+    for (int i = 1; i < depth; i++) used += sprintf(key + used, "next.");
+    sprintf(key + used, "level");
+    bench_getter_t getter = { doc, key };
+    snprintf(name, sizeof(name), "json_key_index depth %d", depth);
+    bench_run(name, 0, bench_key_index, &getter);
+  }
+}
+
+
+typedef struct bench_shape {
+    bench_doc_t *doc;
+    json_path_t path;
+    json_shape_cache_t cache;
+} bench_shape_t;
+
+static void bench_shape_key_index (void *context) {
+  bench_shape_t *shape = context;
+  bench_sink += json_shape_key_index(&shape->cache, 0, shape->doc->json, shape->doc->tokens, shape->doc->token_count);
+}
+
+
+// a key after a large value, found by a full lookup and by a shape cache hit
+static void bench_shape (bench_doc_t *array) {
+  static const char tail[] = ",\"sub\":{\"index\":23}}";
+  bench_doc_t doc = { .name = "large object" };
+  doc.json = malloc(array->length + sizeof(tail) + 16);
+  doc.length = sprintf(doc.json, "{\"data\":%s%s", array->json, tail);
+  bench_doc_tokens(&doc);
+  bench_getter_t getter = { &doc, "sub.index" };
+  bench_shape_t shape = { .doc = &doc };
+  json_path_compile("sub.index", &shape.path);
+  json_shape_cache_init(&shape.cache, &shape.path, 1);
+  printf("\nkey after a %d token value\n", doc.token_count);
+  bench_run("json_key_index(sub.index)", 0, bench_key_index, &getter);
+  bench_run("json_shape_key_index(sub.index) hit", 0, bench_shape_key_index, &shape);
+  json_free(doc.tokens);
+  free(doc.json);
+}
+
+
+static void bench_iterate (void *context) {
+  bench_doc_t *doc = context;
+  json_iter_t it;
+  int key, value;
+  int64_t sum = 0;
+  json_iter_begin(&it, doc->tokens, 0);
+  while (json_iter_next(&it, &key, &value) == 1) sum += value;
+  bench_sink += sum;
+}
+
+
+static void bench_root_indicies (void *context) {
+  bench_doc_t *doc = context;
+  int *indices = NULL;
+  int64_t sum = 0;
+  int count = json_root_array_indicies(doc->tokens, 0, &indices);
+  for (int i = 0; i < count; i++) sum += indices[i];
+  json_free(indices);
+  bench_sink += sum;
+}
+
+
+typedef struct bench_unescape {
+    const char *src;
+    size_t length;
+    char *dst;
+} bench_unescape_t;
+
+static void bench_unescape_fast (void *context) {
+  bench_unescape_t *u = context;
+  size_t length;
+  bench_sink += json_unescape(u->src, u->length, u->dst, u->length + 1, &length) + length;
+}
+
+static void bench_unescape_slow (void *context) {
+  bench_unescape_t *u = context;
+  size_t length;
+  bench_sink += json_unescape_scalar(u->src, u->length, u->dst, u->length + 1, &length) + length;
+}
+
+
+#define BENCH_NUMBER_COUNT 1024
+
+typedef struct bench_numbers {
+    char text[BENCH_NUMBER_COUNT][32];
+    size_t length[BENCH_NUMBER_COUNT];
+    size_t bytes;
+} bench_numbers_t;
+
+static void bench_parse_double (void *context) {
+  bench_numbers_t *n = context;
+  double sum = 0, value;
+  for (int i = 0; i < BENCH_NUMBER_COUNT; i++) {
+    json_parse_double(n->text[i], n->text[i] + n->length[i], &value);
+    sum += value;
+  }
+  bench_sink += (int64_t)sum;
+}
+
+static void bench_strtod (void *context) {
+  bench_numbers_t *n = context;
+  double sum = 0;
+  for (int i = 0; i < BENCH_NUMBER_COUNT; i++) sum += strtod(n->text[i], NULL);
+  bench_sink += (int64_t)sum;
+}
+
+
+static int bench_record (const char *json, size_t length, json_token_t *tokens, int token_count, void *context) {
+  (void)json;
+  (void)length;
+  (void)tokens;
+  (void)context;
+  bench_sink += token_count;
+  return 0;
+}
+
+static void bench_batch (void *context) {
+  bench_doc_t *doc = context;
+  bench_sink += json_parse_batch(doc->json, doc->length, bench_record, NULL, NULL);
+}
+
+
+#if defined(JSON_ENABLE_THREADS)
+typedef struct bench_pool {
+    json_pool_t *pool;
+    json_document_t *documents;
+    int document_count;
+    bench_doc_t *doc;
+} bench_pool_t;
+
+static void bench_pool_parse (void *context) {
+  bench_pool_t *p = context;
+  bench_sink += json_pool_parse(p->pool, p->documents, p->document_count, bench_record, NULL);
+}
+
+static void bench_parallel (void *context) {
+  bench_pool_t *p = context;
+  json_token_t *tokens = NULL;
+  bench_sink += json_parse_array_parallel(p->pool, p->doc->json, p->doc->length, &tokens);
+  json_free(tokens);
+}
+
+
+static void bench_threads (bench_doc_t *records, bench_doc_t *huge) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int max_threads = cpus > 4 ? (int)cpus : 4;
+  char name[64];
+
+  // one document per ndjson line
+  int document_count = 0;
+  json_document_t *documents = malloc(sizeof(json_document_t) * records->length);
+  for (const char *c = records->json, *end = c + records->length; c < end; ) {
+    const char *newline = memchr(c, '\n', end - c);
+    if (newline == NULL) newline = end;
+    if (newline > c) {
+      documents[document_count].json = c;
+      documents[document_count].length = newline - c;
+      document_count += 1;
+    }
+    c = newline + 1;
+  }
+
+  printf("\nthread pool, %ld cpus online\n", cpus);
+  // the parallel parse is compared with the serial structural tokenizer on the same document
+  double serial = bench_run("json_parse_tokens_structural serial", huge->length, bench_parse_structural, huge);
+  // powers of two, then all online cpus when that is not a power of two
+  for (int threads = 1; threads <= max_threads; threads = threads < max_threads && threads * 2 > max_threads ? max_threads : threads * 2) {
+    bench_pool_t p = { json_pool_create(threads), documents, document_count, huge };
+    if (p.pool == NULL) break;
+    snprintf(name, sizeof(name), "json_pool_parse %d threads", threads);
+    bench_run(name, records->length, bench_pool_parse, &p);
+    snprintf(name, sizeof(name), "json_parse_array_parallel %d threads", threads);
+    double parallel = bench_run(name, huge->length, bench_parallel, &p);
+    printf("%-48s %14.2fx serial structural\n", "", serial / parallel);
+    json_pool_free(p.pool);
+  }
+  free(documents);
+}
+#endif
+
+
+int main (void) {
+  char name[64];
+  bench_doc_t docs[5];
+  memset(docs, 0, sizeof(docs));
+  docs[0].name = "config.json";
+  docs[1].name = "sensors.json";
+  docs[2].name = "nested.json";
+  for (int i = 0; i < 3; i++) docs[i].json = bench_read(docs[i].name, &docs[i].length);
+  docs[3].name = "generated 1 MB";
+  docs[3].json = bench_generate(BENCH_LARGE_LENGTH, &docs[3].length);
+  docs[4].name = "generated 8 MB";
+  docs[4].json = bench_generate(BENCH_HUGE_LENGTH, &docs[4].length);
+  for (int i = 0; i < 5; i++) bench_doc_tokens(&docs[i]);
+
+  printf("tokenizing\n");
+  for (int i = 0; i < 5; i++) {
+    if (docs[i].length <= BENCH_JSMN_MAX_LENGTH) {
+      snprintf(name, sizeof(name), "json_parse_tokens %s", docs[i].name);
+      bench_run(name, docs[i].length, bench_parse_jsmn, &docs[i]);
+    }
+    snprintf(name, sizeof(name), "json_parse_tokens_structural %s", docs[i].name);
+    bench_run(name, docs[i].length, bench_parse_structural, &docs[i]);
+  }
+
+  // three fields from the config, one record from the generated documents
+  static const char *selected[] = { "mqtt.port", "device.name", "thresholds.soil" };
+  bench_select_t select = { .doc = &docs[0], .path_count = 3 };
+  for (int i = 0; i < 3; i++) json_path_compile(selected[i], &select.paths[i]);
+  bench_run("json_parse_tokens_selected config.json", docs[0].length, bench_parse_selected, &select);
+  select.path_count = 1;
+  json_path_compile("[100].samples", &select.paths[0]);
+  for (int i = 3; i < 5; i++) {
+    select.doc = &docs[i];
+    snprintf(name, sizeof(name), "json_parse_tokens_selected %s", docs[i].name);
+    bench_run(name, docs[i].length, bench_parse_selected, &select);
+  }
+
+  bench_getters(&docs[0]);
+  bench_getter_t raw = { &docs[1], "raw" };
+  bench_run("json_get_array_i32(raw) sensors.json", 0, bench_get_array_i32, &raw);
+  bench_depths(&docs[2]);
+  bench_shape(&docs[3]);
+
+  printf("\narray enumeration\n");
+  for (int i = 3; i < 5; i++) {
+    snprintf(name, sizeof(name), "json_iter_next %s", docs[i].name);
+    bench_run(name, docs[i].length, bench_iterate, &docs[i]);
+    snprintf(name, sizeof(name), "json_root_array_indicies %s", docs[i].name);
+    bench_run(name, docs[i].length, bench_root_indicies, &docs[i]);
+    // the middle element by subscript, stepping over the elements before it
+    char subscript[32];
+    snprintf(subscript, sizeof(subscript), "[%d]", json_tok_size(&docs[i].tokens[0]) / 2);
+    bench_getter_t middle = { &docs[i], subscript };
+    snprintf(name, sizeof(name), "json_value_index(%s) %s", subscript, docs[i].name);
+    bench_run(name, 0, bench_value_index, &middle);
+  }
+
+  // a long string with an escape every few characters
+  bench_unescape_t unescape;
+  char *src = malloc(BENCH_LARGE_LENGTH);
+  size_t used = 0;
+  while (used < BENCH_LARGE_LENGTH - 64) used += sprintf(src + used, "plain text %s ", bench_random() & 1 ? "\\\"quoted\\\"" : "caf\\u00e9");
+  unescape.src = src;
+  unescape.length = used;
+  unescape.dst = malloc(used + 1);
+  printf("\nunescaping\n");
+  bench_run("json_unescape escape heavy", used, bench_unescape_fast, &unescape);
+  bench_run("json_unescape_scalar escape heavy", used, bench_unescape_slow, &unescape);
+  // the same length of text without a backslash, copied in bulk
+  char *plain = malloc(used);
+  for (size_t i = 0; i < used; i++) plain[i] = "plain text "[i % 11];
+  bench_unescape_t unescaped = { plain, used, unescape.dst };
+  bench_run("json_unescape escape free", used, bench_unescape_fast, &unescaped);
+  bench_run("json_unescape_scalar escape free", used, bench_unescape_slow, &unescaped);
+
+  bench_numbers_t *numbers = malloc(sizeof(bench_numbers_t));
+  numbers->bytes = 0;
+  for (int i = 0; i < BENCH_NUMBER_COUNT; i++) {
+    numbers->length[i] = sprintf(numbers->text[i], "%u.%03ue%d", bench_random() % 100000, bench_random() % 1000, (int)(bench_random() % 20) - 10);
+    numbers->bytes += numbers->length[i];
+  }
+  printf("\nnumbers, %d per op\n", BENCH_NUMBER_COUNT);
+  bench_run("json_parse_double", numbers->bytes, bench_parse_double, numbers);
+  bench_run("strtod", numbers->bytes, bench_strtod, numbers);
+
+  // the ndjson corpus repeated up to 1 MB
+  bench_doc_t records;
+  memset(&records, 0, sizeof(records));
+  records.name = "records.ndjson";
+  size_t record_length;
+  char *record = bench_read(records.name, &record_length);
+  records.json = malloc(BENCH_LARGE_LENGTH + record_length + 1);
+  while (records.length < BENCH_LARGE_LENGTH) {
+    memcpy(records.json + records.length, record, record_length);
+    records.length += record_length;
+  }
+  records.json[records.length] = '\0';
+  printf("\nrecords\n");
+  bench_run("json_parse_batch 1 MB ndjson", records.length, bench_batch, &records);
+
+#if defined(JSON_ENABLE_THREADS)
+  bench_threads(&records, &docs[4]);
+#endif
+
+  free(record);
+  free(records.json);
+  free(numbers);
+  free(src);
+  free(plain);
+  free(unescape.dst);
+  for (int i = 0; i < 5; i++) {
+    json_free(docs[i].tokens);
+    free(docs[i].json);
+  }
+  return 0;
+}
@@ -51,17 +51,34 @@ const char * JSON = TEST_JSON;
 
 
 // declare methods
-void printToken (jsmntok_t *t, int index, char *json);
+void printToken (json_token_t *t, int index, char *json);
 int test_json_length (char *json);
 int test_json_token_count (jsmn_parser *parser, char *json);
-int test_json_get_value_s (jsmntok_t *tokens, char *json);
-int test_json_get_value_i (jsmntok_t *tokens, char *json);
-int test_json_get_value_d (jsmntok_t *tokens, char *json);
-int test_json_get_value_b (jsmntok_t *tokens, char *json);
-int test_json_key_index (jsmntok_t *tokens, char *json);
-int test_json_root_key_index (jsmntok_t *tokens, char *json);
-int test_json_root_object_indicies (jsmntok_t *tokens);
-int test_json_root_array_indicies (jsmntok_t *tokens);
+int test_json_parse_tokens_grow (jsmn_parser *parser, char *json);
+int test_json_parse_tokens_structural (jsmn_parser *parser, char *json);
+int test_json_tokens_compact (jsmn_parser *parser, char *json);
+int test_json_parse_tokens_n (jsmn_parser *parser, char *json);
+int test_json_feed (char *json);
+int test_json_get_value_s (json_token_t *tokens, char *json);
+int test_json_get_value_sv (json_token_t *tokens, char *json);
+int test_json_get_value_i (json_token_t *tokens, char *json);
+int test_json_get_value_d (json_token_t *tokens, char *json);
+int test_json_get_value_b (json_token_t *tokens, char *json);
+int test_json_key_index (json_token_t *tokens, char *json);
+int test_json_value_index (json_token_t *tokens, char *json);
+int test_json_root_key_index (json_token_t *tokens, char *json);
+int test_json_root_object_indicies (json_token_t *tokens);
+int test_json_root_array_indicies (json_token_t *tokens);
+int test_json_iter (json_token_t *tokens, char *json);
+int test_json_get_array (json_token_t *tokens, char *json);
+int test_json_arena (jsmn_parser *parser, char *json);
+int test_json_path (json_token_t *tokens, char *json);
+int test_json_shape_cache (json_token_t *tokens, char *json);
+int test_json_get_fields (json_token_t *tokens, char *json);
+int test_json_scan_value (char *json);
+int test_json_parse_tokens_selected (char *json);
+int test_json_parse_batch (char *json);
+int test_json_token_table (json_token_t *tokens, char *json);
 
 
 
@@ -73,7 +90,7 @@ int main() {
 
   
   jsmn_parser parser;
-	jsmntok_t *tokens;
+	json_token_t *tokens;
   int status;
 	int token_count;
 
@@ -100,6 +117,41 @@ int main() {
   printf("json_token_count test passed\n");
 
 
+  printf("Testing json_parse_tokens_grow...\n");
+  if (0 != test_json_parse_tokens_grow(&parser, (char*)JSON)) {
+    panic("json_parse_tokens_grow test failed");
+  }
+  printf("json_parse_tokens_grow test passed\n");
+
+
+  printf("Testing json_parse_tokens_structural...\n");
+  if (0 != test_json_parse_tokens_structural(&parser, (char*)JSON)) {
+    panic("json_parse_tokens_structural test failed");
+  }
+  printf("json_parse_tokens_structural test passed\n");
+
+
+  printf("Testing json_tokens_compact...\n");
+  if (0 != test_json_tokens_compact(&parser, (char*)JSON)) {
+    panic("json_tokens_compact test failed");
+  }
+  printf("json_tokens_compact test passed\n");
+
+
+  printf("Testing json_parse_tokens_n...\n");
+  if (0 != test_json_parse_tokens_n(&parser, (char*)JSON)) {
+    panic("json_parse_tokens_n test failed");
+  }
+  printf("json_parse_tokens_n test passed\n");
+
+
+  printf("Testing json_feed...\n");
+  if (0 != test_json_feed((char*)JSON)) {
+    panic("json_feed test failed");
+  }
+  printf("json_feed test passed\n");
+
+
   printf("Testing json_parse_tokens...\n");
   if (TEST_JSON_TOKEN_COUNT != json_parse_tokens(&parser, (char*)JSON, &tokens)) {
     panic("json_parse_tokens test failed");
@@ -114,6 +166,13 @@ int main() {
   printf("json_get_value_s test passed\n");
 
 
+  printf("Testing json_get_value_sv...\n");
+  if (0 != test_json_get_value_sv(tokens, (char*)JSON)) {
+    panic("json_get_value_sv test failed");
+  }
+  printf("json_get_value_sv test passed\n");
+
+
   printf("Testing json_get_value_i...\n");
   if (0 != test_json_get_value_i(tokens, (char*)JSON)) {
     panic("json_get_value_i test failed");
@@ -135,11 +194,25 @@ int main() {
   printf("json_get_value_b test passed\n");
 
 
+  printf("Testing json_get_array...\n");
+  if (0 != test_json_get_array(tokens, (char*)JSON)) {
+    panic("json_get_array test failed");
+  }
+  printf("json_get_array test passed\n");
+
+
   printf("Testing json_key_index...\n");
   if (0 != test_json_key_index(tokens, (char*)JSON)) {
     panic("json_key_index test failed");
   }
   printf("json_key_index test passed\n");
+
+
+  printf("Testing json_value_index...\n");
+  if (0 != test_json_value_index(tokens, (char*)JSON)) {
+    panic("json_value_index test failed");
+  }
+  printf("json_value_index test passed\n");
   
 
   printf("Testing json_root_key_index...\n");
@@ -163,6 +236,69 @@ int main() {
   printf("json_root_array_indicies test passed\n");
 
 
+  printf("Testing json_iter...\n");
+  if (0 != test_json_iter(tokens, (char*)JSON)) {
+    panic("json_iter test failed");
+  }
+  printf("json_iter test passed\n");
+
+
+  printf("Testing json_path...\n");
+  if (0 != test_json_path(tokens, (char*)JSON)) {
+    panic("json_path test failed");
+  }
+  printf("json_path test passed\n");
+
+
+  printf("Testing json_get_fields...\n");
+  if (0 != test_json_get_fields(tokens, (char*)JSON)) {
+    panic("json_get_fields test failed");
+  }
+  printf("json_get_fields test passed\n");
+
+
+  printf("Testing json_shape_cache...\n");
+  if (0 != test_json_shape_cache(tokens, (char*)JSON)) {
+    panic("json_shape_cache test failed");
+  }
+  printf("json_shape_cache test passed\n");
+
+
+  printf("Testing json_scan_value...\n");
+  if (0 != test_json_scan_value((char*)JSON)) {
+    panic("json_scan_value test failed");
+  }
+  printf("json_scan_value test passed\n");
+
+
+  printf("Testing json_parse_tokens_selected...\n");
+  if (0 != test_json_parse_tokens_selected((char*)JSON)) {
+    panic("json_parse_tokens_selected test failed");
+  }
+  printf("json_parse_tokens_selected test passed\n");
+
+
+  printf("Testing json_parse_batch...\n");
+  if (0 != test_json_parse_batch((char*)JSON)) {
+    panic("json_parse_batch test failed");
+  }
+  printf("json_parse_batch test passed\n");
+
+
+  printf("Testing json_token_table...\n");
+  if (0 != test_json_token_table(tokens, (char*)JSON)) {
+    panic("json_token_table test failed");
+  }
+  printf("json_token_table test passed\n");
+
+
+  printf("Testing json_arena...\n");
+  if (0 != test_json_arena(&parser, (char*)JSON)) {
+    panic("json_arena test failed");
+  }
+  printf("json_arena test passed\n");
+
+
   panic("Testing complete.");
 
 }
@@ -170,12 +306,12 @@ int main() {
 
 
 // print details about a specific jsmn token
-void printToken (jsmntok_t *toks, int index, char *json) {
-  jsmntok_t *t = &toks[index];
+void printToken (json_token_t *toks, int index, char *json) {
+  json_token_t *t = &toks[index];
       // printf("I: %d %d %d\n", index, t->start, t->end);
-  char *token_key = calloc(t->end - t->start + 1, sizeof(char));
-  strncpy(token_key, &json[t->start], t->end - t->start);
-  printf("TOKEN: i %d, s %d, e %d, z %d, t %d, v %s\n", index, t->start, t->end, t->size, t->type, token_key);
+  char *token_key = calloc(json_tok_end(t) - json_tok_start(t) + 1, sizeof(char));
+  strncpy(token_key, &json[json_tok_start(t)], json_tok_end(t) - json_tok_start(t));
+  printf("TOKEN: i %d, s %ld, e %ld, z %d, t %d, v %s\n", index, (long)json_tok_start(t), (long)json_tok_end(t), json_tok_size(t), json_tok_type(t), token_key);
   free(token_key);
 }
 
@@ -198,7 +334,91 @@ int test_json_token_count (jsmn_parser *parser, char *json) {
 }
 
 
-int test_json_get_value_s (jsmntok_t *tokens, char *json) {
+int test_json_parse_tokens_grow (jsmn_parser *parser, char *json) {
+  jsmntok_t *tokens = NULL;
+  unsigned int capacity = 1;
+  if (json_estimate_token_count(json, strlen(json)) < TEST_JSON_TOKEN_COUNT) return -1;
+  jsmn_init(parser);
+  int token_count = json_parse_tokens_grow(parser, json, strlen(json), &tokens, &capacity);
+  free(tokens);
+  if (token_count != TEST_JSON_TOKEN_COUNT) return -1;
+  if (capacity < TEST_JSON_TOKEN_COUNT) return -1;
+  return 0;
+}
+
+
+int test_json_parse_tokens_structural (jsmn_parser *parser, char *json) {
+  json_token_t *expected = NULL;
+  json_token_t *tokens = NULL;
+  int result = -1;
+  int expected_count = json_parse_tokens(parser, json, &expected);
+  int token_count = json_parse_tokens_structural(parser, json, strlen(json), &tokens);
+  if (token_count == TEST_JSON_TOKEN_COUNT && token_count == expected_count) {
+    result = memcmp(tokens, expected, sizeof(json_token_t) * token_count) == 0 ? 0 : -1;
+  }
+  json_free(expected);
+  json_free(tokens);
+  return result;
+}
+
+
+int test_json_tokens_compact (jsmn_parser *parser, char *json) {
+  jsmntok_t *parsed = NULL;
+  json_token_t *tokens = NULL;
+  unsigned int capacity = 0;
+  int index = 0;
+  int result = -1;
+  jsmn_init(parser);
+  int token_count = json_parse_tokens_grow(parser, json, strlen(json), &parsed, &capacity);
+  if (token_count == TEST_JSON_TOKEN_COUNT && json_tokens_compact(parsed, token_count, &tokens) == JSON_ERR_NONE) {
+    // the compact tokens work with every getter
+    if (json_get_value_i(TEST3_KEY, &index, json, tokens, 0) == JSON_ERR_NONE && index == TEST3_VALUE) result = 0;
+    if (json_tok_type(&tokens[0]) != JSMN_OBJECT || json_tok_end(&tokens[0]) != (int)strlen(json)) result = -1;
+  }
+  json_free(parsed);
+  return result;
+}
+
+
+int test_json_parse_tokens_n (jsmn_parser *parser, char *json) {
+  json_token_t *tokens = NULL;
+  int index = 0;
+  int result = -1;
+  size_t length = strlen(json);
+  // copy the document into a larger buffer with trailing text and no NUL after it
+  char *buffer = malloc(length + 8);
+  if (buffer == NULL) return -1;
+  memcpy(buffer, json, length);
+  memcpy(buffer + length, "{\"x\":1}", 8);
+  if (json_parse_tokens_n(parser, buffer, length, &tokens) == TEST_JSON_TOKEN_COUNT) {
+    if (json_get_value_i(TEST3_KEY, &index, buffer, tokens, 0) == JSON_ERR_NONE && index == TEST3_VALUE) result = 0;
+  }
+  json_free(tokens);
+  free(buffer);
+  return result;
+}
+
+
+int test_json_feed (char *json) {
+  json_stream_t stream;
+  int result = JSON_STREAM_NEED_MORE;
+  int value = 0;
+  size_t length = strlen(json);
+  json_stream_init(&stream);
+  // feed the JSON in small chunks
+  for (size_t offset = 0; offset < length; offset += 5) {
+    result = json_feed(&stream, json + offset, length - offset < 5 ? length - offset : 5);
+    if (result < 0) break;
+  }
+  if (result == JSON_STREAM_COMPLETE && stream.token_count == TEST_JSON_TOKEN_COUNT) {
+    if (json_get_value_i(TEST4_KEY, &value, stream.buffer, stream.tokens, 0) != JSON_ERR_NONE) value = 0;
+  }
+  json_stream_free(&stream);
+  return value == TEST4_VALUE ? 0 : -1;
+}
+
+
+int test_json_get_value_s (json_token_t *tokens, char *json) {
   int err;
   char *value = NULL;
   if ((err = json_get_value_s(TEST1_KEY, &value, json, tokens, 0)) != JSON_ERR_NONE) {
@@ -238,7 +458,32 @@ int test_json_get_value_s (jsmntok_t *tokens, char *json) {
 }
 
 
-int test_json_get_value_i (jsmntok_t *tokens, char *json) {
+int test_json_get_value_sv (json_token_t *tokens, char *json) {
+  int err;
+  json_string_view_t view;
+  char buffer[4];
+  size_t length = 0;
+  if ((err = json_get_value_sv(TEST2_KEY, &view, json, tokens, 0)) != JSON_ERR_NONE) {
+    printf("Get value %s failed, %s\n", TEST2_KEY, json_error_string(err));
+    return -1;
+  }
+  if (view.len != strlen(TEST2_VALUE) || strncmp(view.ptr, TEST2_VALUE, view.len) != 0) return -1;
+
+  if ((err = json_get_value_sn(TEST1_KEY, buffer, sizeof(buffer), &length, json, tokens, 0)) != JSON_ERR_TRUNCATED) {
+    printf("Expected error '%s', but got '%s'\n", json_error_string(JSON_ERR_TRUNCATED), json_error_string(err));
+    return -1;
+  }
+  if (length != strlen(TEST1_VALUE) || strncmp(buffer, TEST1_VALUE, sizeof(buffer) - 1) != 0) return -1;
+
+  char decoded[8];
+  if (json_unescape("a\\n\\u00e9", 9, decoded, sizeof(decoded), &length) != JSON_ERR_NONE) return -1;
+  if (length != 4 || memcmp(decoded, "a\n\xc3\xa9", 4) != 0) return -1;
+
+  return 0;
+}
+
+
+int test_json_get_value_i (json_token_t *tokens, char *json) {
   int err;
   int value = 0;
   if ((err = json_get_value_i(TEST3_KEY, &value, json, tokens, 0)) != JSON_ERR_NONE) {
@@ -259,11 +504,27 @@ int test_json_get_value_i (jsmntok_t *tokens, char *json) {
     return -1;
   }
 
+  int64_t value64 = 0;
+  if ((err = json_get_value_i64(TEST3_KEY, &value64, json, tokens, 0)) != JSON_ERR_NONE || value64 != TEST3_VALUE) {
+    printf("Get value %s failed, %s\n", TEST3_KEY, json_error_string(err));
+    return -1;
+  }
+
+  // the int getter truncates a fraction toward zero, the int64_t getter rejects it
+  if ((err = json_get_value_i(TEST11_KEY, &value, json, tokens, 0)) != JSON_ERR_NONE || value != (int)TEST11_VALUE) {
+    printf("Expected '%d', but got '%d', %s\n", (int)TEST11_VALUE, value, json_error_string(err));
+    return -1;
+  }
+  if ((err = json_get_value_i64(TEST11_KEY, &value64, json, tokens, 0)) != JSON_ERR_INVALID) {
+    printf("Expected error '%s', but got '%s'\n", json_error_string(JSON_ERR_INVALID), json_error_string(err));
+    return -1;
+  }
+
   return 0;
 }
 
 
-int test_json_get_value_d (jsmntok_t *tokens, char *json) {
+int test_json_get_value_d (json_token_t *tokens, char *json) {
   int err;
   double value = 0;
   if ((err = json_get_value_d(TEST11_KEY, &value, json, tokens, 0)) != JSON_ERR_NONE) {
@@ -275,11 +536,21 @@ int test_json_get_value_d (jsmntok_t *tokens, char *json) {
     return -1;
   }
 
+  int64_t fixed = 0;
+  if ((err = json_get_value_fixed(TEST11_KEY, &fixed, 3, json, tokens, 0)) != JSON_ERR_NONE) {
+    printf("Get value %s failed, %s\n", TEST11_KEY, json_error_string(err));
+    return -1;
+  }
+  if (fixed != 1230) {
+    printf("Expected '1230', but got '%lld',\n", (long long)fixed);
+    return -1;
+  }
+
   return 0;
 }
 
 
-int test_json_get_value_b (jsmntok_t *tokens, char *json) {
+int test_json_get_value_b (json_token_t *tokens, char *json) {
   int err;
   bool value = false;
   if ((err = json_get_value_b(TEST12_KEY, &value, json, tokens, 0)) != JSON_ERR_NONE) {
@@ -295,7 +566,7 @@ int test_json_get_value_b (jsmntok_t *tokens, char *json) {
 }
 
 
-int test_json_key_index (jsmntok_t *tokens, char *json) {
+int test_json_key_index (json_token_t *tokens, char *json) {
   int result;
   if ((result = json_key_index(tokens, 0, TEST5_KEY, json)) < 0) {
     printf("Key index failed, %s\n", json_error_string(result));
@@ -311,7 +582,26 @@ int test_json_key_index (jsmntok_t *tokens, char *json) {
 }
 
 
-int test_json_root_key_index (jsmntok_t *tokens, char *json) {
+int test_json_value_index (json_token_t *tokens, char *json) {
+  int value = 0;
+  // array subscripts and JSON Pointers select elements without building an index array
+  if (json_get_value_i("end[2]", &value, json, tokens, 0) != JSON_ERR_NONE || value != 1) {
+    printf("Value index failed for end[2]\n");
+    return -1;
+  }
+  if (json_get_value_i("/array/1", &value, json, tokens, 0) != JSON_ERR_NONE || value != 2) {
+    printf("Value index failed for /array/1\n");
+    return -1;
+  }
+  if (json_value_index(tokens, 0, "/sub/index", json) != json_key_index(tokens, 0, TEST4_KEY, json) + 1) {
+    printf("Value index failed for /sub/index\n");
+    return -1;
+  }
+  return 0;
+}
+
+
+int test_json_root_key_index (json_token_t *tokens, char *json) {
   int index = json_root_key_index(tokens, 0, TEST7_KEY, json);
   if (index < 0) {
     printf("Root key index failed, %s\n", json_error_string(index));
@@ -325,7 +615,7 @@ int test_json_root_key_index (jsmntok_t *tokens, char *json) {
 }
 
 
-int test_json_root_object_indicies (jsmntok_t *tokens) {
+int test_json_root_object_indicies (json_token_t *tokens) {
   int *indicies = NULL;
   int key_count = json_root_object_indicies(tokens, 0, &indicies);
   if (key_count < 0) {
@@ -356,7 +646,7 @@ int test_json_root_object_indicies (jsmntok_t *tokens) {
 }
 
 
-int test_json_root_array_indicies (jsmntok_t *tokens) {
+int test_json_root_array_indicies (json_token_t *tokens) {
   int *indicies = NULL;
   int key_count = json_root_array_indicies(tokens, TEST10_INDEX, &indicies);
   if (key_count < 0) {
@@ -372,3 +662,184 @@ int test_json_root_array_indicies (jsmntok_t *tokens) {
 
   return 0;
 }
+
+
+int test_json_arena (jsmn_parser *parser, char *json) {
+  static uint8_t buffer[2048];
+  json_arena_t arena;
+  json_allocator_t allocator;
+  json_token_t *tokens = NULL;
+  char *value = NULL;
+  json_arena_init(&arena, &allocator, buffer, sizeof(buffer));
+  json_set_allocator(&allocator);
+  int token_count = json_parse_tokens(parser, json, &tokens);
+  int err = json_get_value_s(TEST2_KEY, &value, json, tokens, 0);
+  json_set_allocator(NULL);
+  if (token_count != TEST_JSON_TOKEN_COUNT || err != JSON_ERR_NONE) return -1;
+  if (strcmp(value, TEST2_VALUE) != 0) return -1;
+  if (arena.used == 0) return -1;
+  json_arena_reset(&arena);
+  if (arena.used != 0) return -1;
+  return 0;
+}
+
+
+int test_json_token_table (json_token_t *tokens, char *json) {
+  json_token_table_t table;
+  if (json_token_table_build(&table, tokens, TEST_JSON_TOKEN_COUNT) != JSON_ERR_NONE) return -1;
+  table.hash_keys = true;
+  json_token_table_attach(&table);
+  int result = 0;
+  if (json_last_object_token_index(tokens, TEST9_START) != TEST7_INDEX - 1) result = -1;
+  if (json_root_key_index(tokens, 0, TEST7_KEY, json) != TEST7_INDEX) result = -1;
+  if (test_json_root_object_indicies(tokens) != 0) result = -1;
+  if (test_json_get_value_s(tokens, json) != 0) result = -1;
+  json_token_table_free(&table);
+  return result;
+}
+
+
+int test_json_path (json_token_t *tokens, char *json) {
+  json_path_t path;
+  int value = 0;
+  if (json_path_compile(TEST6_KEY, &path) != JSON_ERR_NONE) return -1;
+  if (json_path_lookup(&path, json, tokens, 0) != TEST6_INDEX) return -1;
+  if (json_path_compile(TEST4_KEY, &path) != JSON_ERR_NONE) return -1;
+  if (json_get_path_i(&path, &value, json, tokens, 0) != JSON_ERR_NONE) return -1;
+  if (value != TEST4_VALUE) return -1;
+  if (json_path_compile("", &path) != JSON_ERR_KEY_INVALID) return -1;
+  return 0;
+}
+
+
+int test_json_shape_cache (json_token_t *tokens, char *json) {
+  json_path_t paths[1];
+  json_shape_cache_t cache;
+  if (json_path_compile(TEST6_KEY, &paths[0]) != JSON_ERR_NONE) return -1;
+  if (json_shape_cache_init(&cache, paths, 1) != JSON_ERR_NONE) return -1;
+  for (int i = 0; i < 2; i++) {
+    if (json_shape_key_index(&cache, 0, json, tokens, TEST_JSON_TOKEN_COUNT) != TEST6_INDEX) return -1;
+  }
+  if (cache.misses != 1 || cache.hits != 1) return -1;
+  return 0;
+}
+
+
+int test_json_get_fields (json_token_t *tokens, char *json) {
+  char *title = NULL;
+  int first = 0;
+  int index = 0;
+  json_field_t fields[] = {
+    { TEST2_KEY, JSON_FIELD_STRING, &title },
+    { TEST3_KEY, JSON_FIELD_INT, &first },
+    { TEST4_KEY, JSON_FIELD_INT, &index },
+    { "nokey", JSON_FIELD_INT, &index }
+  };
+  uint64_t elapsed_us = 0;
+  int found = json_get_fields(fields, 4, json, tokens, 0, &elapsed_us);
+  printf("json_get_fields took %llu us\n", (unsigned long long)elapsed_us);
+  int result = 0;
+  if (found != 3) result = -1;
+  else if (strcmp(title, TEST2_VALUE) != 0 || first != TEST3_VALUE || index != TEST4_VALUE) result = -1;
+  else if (fields[3].found || fields[3].status != JSON_ERR_KEY_INVALID) result = -1;
+  json_free(title);
+  return result;
+}
+
+
+int test_json_scan_value (char *json) {
+  json_string_view_t view;
+  size_t length = strlen(json);
+  if (json_scan_value(json, length, TEST2_KEY, &view) != JSMN_STRING) return -1;
+  if (view.len != strlen(TEST2_VALUE) || strncmp(view.ptr, TEST2_VALUE, view.len) != 0) return -1;
+  if (json_scan_value(json, length, TEST4_KEY, &view) != JSMN_PRIMITIVE) return -1;
+  if (view.len != 2 || strncmp(view.ptr, "23", 2) != 0) return -1;
+  if (json_scan_value(json, length, TEST5_KEY, &view) != JSMN_ARRAY) return -1;
+  if (json_scan_value(json, length, "sub.nokey", &view) != JSON_ERR_KEY_INVALID) return -1;
+  return 0;
+}
+
+
+int test_json_batch_record (const char *json, size_t length, json_token_t *tokens, int token_count, void *context) {
+  int value = 0;
+  if (token_count != TEST_JSON_TOKEN_COUNT) return -1;
+  if (json_get_value_i(TEST4_KEY, &value, json, tokens, 0) != JSON_ERR_NONE) return -1;
+  *(int *)context += value;
+  return 0;
+}
+
+
+int test_json_parse_tokens_selected (char *json) {
+  json_path_t paths[2];
+  json_token_t *tokens = NULL;
+  int index = 0;
+  int last = 0;
+  int result = -1;
+  json_path_compile(TEST4_KEY, &paths[0]);
+  json_path_compile("end[2]", &paths[1]);
+  // only the selected values and the containers leading to them are tokenized
+  int token_count = json_parse_tokens_selected(paths, 2, json, strlen(json), &tokens);
+  if (token_count > 0 && token_count < TEST_JSON_TOKEN_COUNT &&
+    json_get_value_i(TEST4_KEY, &index, json, tokens, 0) == JSON_ERR_NONE && index == TEST4_VALUE &&
+    json_get_value_i("end[2]", &last, json, tokens, 0) == JSON_ERR_NONE && last == 1 &&
+    json_get_value_i(TEST3_KEY, &index, json, tokens, 0) == JSON_ERR_KEY_INVALID) {
+    result = 0;
+  }
+  json_free(tokens);
+  return result;
+}
+
+
+int test_json_parse_batch (char *json) {
+  // three newline delimited copies of the test JSON
+  size_t length = strlen(json);
+  char *records = malloc(length * 3 + 4);
+  if (records == NULL) return -1;
+  sprintf(records, "%s\n%s\n%s\n", json, json, json);
+  int sum = 0;
+  json_batch_stats_t stats;
+  int count = json_parse_batch(records, strlen(records), test_json_batch_record, &sum, &stats);
+  free(records);
+  if (count != 3 || stats.records != 3 || stats.errors != 0) return -1;
+  printf("Batch %d records, %.0f records/s, %.0f bytes/s\n", stats.records, stats.records_per_second, stats.bytes_per_second);
+  return sum == TEST4_VALUE * 3 ? 0 : -1;
+}
+
+
+int test_json_iter (json_token_t *tokens, char *json) {
+  json_iter_t it;
+  int key, value, count = 0, sum = 0;
+  // members of the root object, nested values are skipped
+  if (json_iter_begin(&it, tokens, 0) != JSON_ERR_NONE) return -1;
+  while (json_iter_next(&it, &key, &value) == 1) {
+    if (json_tok_type(&tokens[key]) != JSMN_STRING) return -1;
+    count += 1;
+  }
+  if (count != TEST8_COUNT) return -1;
+  // elements of the array
+  if (json_iter_begin(&it, tokens, TEST10_INDEX) != JSON_ERR_NONE) return -1;
+  count = 0;
+  while (json_iter_next(&it, &key, &value) == 1) {
+    int element;
+    if (key != -1 || json_get_index_i(value, &element, json, tokens) != JSON_ERR_NONE) return -1;
+    sum += element;
+    count += 1;
+  }
+  if (count != TEST10_COUNT || sum != 6) return -1;
+  return json_iter_begin(&it, tokens, 1) == JSON_ERR_INDEX_INVALID ? 0 : -1;
+}
+
+
+int test_json_get_array (json_token_t *tokens, char *json) {
+  int32_t values[3];
+  double numbers[2];
+  size_t count;
+  if (json_get_array_i32(TEST5_KEY, values, 3, &count, json, tokens, 0) != JSON_ERR_NONE) return -1;
+  if (count != 3 || values[0] != 1 || values[1] != 2 || values[2] != 3) return -1;
+  // more elements than capacity
+  if (json_get_array_f64("end", numbers, 2, &count, json, tokens, 0) != JSON_ERR_TRUNCATED) return -1;
+  if (count != 2 || numbers[0] != 3.0 || numbers[1] != 2.0) return -1;
+  // not an array
+  if (json_get_array_i32(TEST3_KEY, values, 3, &count, json, tokens, 0) != JSON_ERR_INVALID) return -1;
+  return 0;
+}
@@ -1,6 +1,11 @@
 
+#include <limits.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#if defined(LIB_PICO_STDLIB)
 #include "pico/stdlib.h"
+#endif
 #define JSMN_HEADER
 #include "jsmn.h"
 
@@ -13,6 +18,8 @@ typedef enum {
     JSON_ERR_MEMORY = -2,
     JSON_ERR_KEY_INVALID = -3,
     JSON_ERR_INDEX_INVALID = -4,
+    JSON_ERR_TRUNCATED = -5,
+    JSON_ERR_RANGE = -6,
 
 
 } JSONErrorCode;
@@ -24,28 +31,412 @@ typedef enum {
 #define MAX_JSON_INPUT_LENGTH 4096
 #endif
 
+#ifndef JSON_KEY_HASH_MIN_KEYS
+#define JSON_KEY_HASH_MIN_KEYS 8
+#endif
+
+#ifndef JSON_PATH_MAX_SEGMENTS
+#define JSON_PATH_MAX_SEGMENTS 8
+#endif
+
+#ifndef JSON_PATH_MAX_LENGTH
+#define JSON_PATH_MAX_LENGTH 64
+#endif
+
+#ifndef JSON_SHAPE_CACHE_MAX_PATHS
+#define JSON_SHAPE_CACHE_MAX_PATHS 16
+#endif
+
+#ifndef JSON_FIELDS_MAX
+#define JSON_FIELDS_MAX 64                                   // fields matched per traversal, at most 64
+#endif
+
+#ifndef JSON_STREAM_MIN_CAPACITY
+#define JSON_STREAM_MIN_CAPACITY 256
+#endif
+
+#define JSON_STREAM_NEED_MORE 0
+#define JSON_STREAM_COMPLETE 1
+
+#ifndef JSON_MIN_TOKEN_CAPACITY
+#define JSON_MIN_TOKEN_CAPACITY 16
+#endif
+
+#ifndef JSON_POOL_ARENA_SIZE
+#define JSON_POOL_ARENA_SIZE 16384                           // scratch arena bytes per pool worker
+#endif
+
+#ifndef JSON_PARALLEL_MIN_LENGTH
+#define JSON_PARALLEL_MIN_LENGTH 65536                       // smaller root arrays are parsed serially
+#endif
+
+#ifndef JSON_PARALLEL_CHUNK_LENGTH
+#define JSON_PARALLEL_CHUNK_LENGTH 65536                     // largest chunk of a root array parsed by one worker
+#endif
+
+#ifndef JSON_PARALLEL_CHUNKS_PER_THREAD
+#define JSON_PARALLEL_CHUNKS_PER_THREAD 4
+#endif
+
+// reader state that is set per caller, i.e. the active allocator, is per thread when threads are enabled
+#if defined(JSON_ENABLE_THREADS)
+#define JSON_THREAD_LOCAL _Thread_local
+#else
+#define JSON_THREAD_LOCAL
+#endif
+
+#ifndef JSON_STRUCTURAL_MAX_DEPTH
+#define JSON_STRUCTURAL_MAX_DEPTH 256                        // deeper documents are parsed with jsmn
+#endif
+
+#ifndef JSON_STRUCTURAL_MAX_INITIAL_TOKENS
+#define JSON_STRUCTURAL_MAX_INITIAL_TOKENS 1048576           // larger inputs grow the token buffer as they are parsed
+#endif
+
+// JSON_COMPACT_TOKENS 16 or 32 stores tokens with 16 or 32 bit offsets, JSON_WIDE_TOKENS with
+// 48 bit offsets for documents over 2 GB, otherwise tokens are jsmntok_t
+#if defined(JSON_COMPACT_TOKENS) && defined(JSON_WIDE_TOKENS)
+#error "JSON_COMPACT_TOKENS and JSON_WIDE_TOKENS are exclusive"
+#endif
+
+#if defined(JSON_COMPACT_TOKENS)
+#if JSON_COMPACT_TOKENS == 16
+typedef uint16_t json_token_word_t;
+#elif JSON_COMPACT_TOKENS == 32
+typedef uint32_t json_token_word_t;
+#else
+#error "JSON_COMPACT_TOKENS must be 16 or 32"
+#endif
+
+typedef struct json_token {
+    json_token_word_t start;
+    json_token_word_t end;
+    json_token_word_t size_type;                             // child count, the top two bits hold the type
+} json_token_t;
+
+#define JSON_TOKEN_TYPE_SHIFT (JSON_COMPACT_TOKENS - 2)
+#define JSON_TOKEN_SIZE_MAX ((1ul << JSON_TOKEN_TYPE_SHIFT) - 1)
+#if JSON_COMPACT_TOKENS == 16
+#define JSON_TOKEN_OFFSET_MAX 65535ul                        // longest document that can be tokenized
+#else
+#define JSON_TOKEN_OFFSET_MAX ((unsigned long)INT_MAX)       // jsmn offsets are int before compaction
+#endif
+
+// the type is stored as the bit index of its jsmntype_t value
+#define json_tok_type(tok) ((jsmntype_t)(1 << ((tok)->size_type >> JSON_TOKEN_TYPE_SHIFT)))
+#define json_tok_start(tok) ((int)(tok)->start)
+#define json_tok_end(tok) ((int)(tok)->end)
+#define json_tok_size(tok) ((int)((tok)->size_type & JSON_TOKEN_SIZE_MAX))
+#define json_tok_set_end(tok, value) ((tok)->end = (json_token_word_t)(value))
+#elif defined(JSON_WIDE_TOKENS)
+typedef uint32_t json_token_word_t;
+
+// the offsets are split in 32 and 16 bit words so a token is no larger than a jsmntok_t
+typedef struct json_token {
+    json_token_word_t start;                                 // low 32 bits of the offsets
+    json_token_word_t end;
+    uint16_t start_high;                                     // high 16 bits of the offsets
+    uint16_t end_high;
+    json_token_word_t size_type;                             // child count, the top two bits hold the type
+} json_token_t;
+
+#define JSON_TOKEN_TYPE_SHIFT 30
+#define JSON_TOKEN_SIZE_MAX ((1ul << JSON_TOKEN_TYPE_SHIFT) - 1)
+#define JSON_TOKEN_OFFSET_MAX ((unsigned long)INT_MAX)       // jsmn offsets are int before widening
+#define JSON_STRUCTURAL_OFFSET_MAX 0xffffffffffffull         // longest document the structural indexer tokenizes
+
+#define json_tok_type(tok) ((jsmntype_t)(1 << ((tok)->size_type >> JSON_TOKEN_TYPE_SHIFT)))
+#define json_tok_start(tok) ((int64_t)(tok)->start_high << 32 | (tok)->start)
+#define json_tok_end(tok) ((int64_t)(tok)->end_high << 32 | (tok)->end)
+#define json_tok_size(tok) ((int)((tok)->size_type & JSON_TOKEN_SIZE_MAX))
+#define json_tok_set_end(tok, value) ((tok)->end = (uint32_t)(value), (tok)->end_high = (uint16_t)((int64_t)(value) >> 32))
+#else
+typedef jsmntok_t json_token_t;
+
+#define JSON_TOKEN_OFFSET_MAX ((unsigned long)INT_MAX)       // longest document that can be tokenized
+
+#define json_tok_type(tok) ((tok)->type)
+#define json_tok_start(tok) ((tok)->start)
+#define json_tok_end(tok) ((tok)->end)
+#define json_tok_size(tok) ((tok)->size)
+#define json_tok_set_end(tok, value) ((tok)->end = (value))
+#endif
+
+#if defined(JSON_COMPACT_TOKENS) || defined(JSON_WIDE_TOKENS)
+#define JSON_PACKED_TOKENS 1                                 // tokens are converted from jsmntok_t in place
+#endif
+
+#ifndef JSON_STRUCTURAL_OFFSET_MAX
+#define JSON_STRUCTURAL_OFFSET_MAX JSON_TOKEN_OFFSET_MAX
+#endif
+
+// the type returned by json_tok_start and json_tok_end
+#if defined(JSON_WIDE_TOKENS)
+typedef int64_t json_token_offset_t;
+#else
+typedef int json_token_offset_t;
+#endif
+
+typedef struct json_allocator {
+    void *context;                                           // passed to each callback
+    void * (*alloc) (void *context, size_t size);
+    void * (*realloc) (void *context, void *ptr, size_t size);
+    void (*free) (void *context, void *ptr);
+} json_allocator_t;
+
+typedef struct json_arena {
+    unsigned char *buffer;
+    size_t capacity;
+    size_t used;
+    size_t last;                                             // offset of the last allocation
+} json_arena_t;
+
+void json_set_allocator (const json_allocator_t *allocator);
+const json_allocator_t * json_get_allocator (void);
+void * json_malloc (size_t size);
+void * json_realloc (void *ptr, size_t size);
+void json_free (void *ptr);
+void json_arena_init (json_arena_t *arena, json_allocator_t *allocator, void *buffer, size_t capacity);
+void json_arena_reset (json_arena_t *arena);
+
+typedef struct json_token_table {
+    json_token_t *tokens;                                       // the token array described by the table
+    int token_count;
+    int *last;                                               // index of the last token in each token's subtree
+    bool hash_keys;                                          // cache a key hash table per searched object
+    int **key_hashes;                                        // lazily built key hash table for each object token
+} json_token_table_t;
+
+typedef struct json_path_segment {
+    uint16_t offset;                                         // offset of the key name in the path names
+    uint16_t length;                                         // length of the key name
+    uint32_t hash;                                           // json_key_hash of the key name
+    int32_t element;                                         // array element index, -1 if the segment is only a key
+    bool key;                                                // false for a [n] subscript, which never matches a key
+} json_path_segment_t;
+
+typedef struct json_path {
+    int segment_count;
+    json_path_segment_t segments[JSON_PATH_MAX_SEGMENTS];
+    char names[JSON_PATH_MAX_LENGTH];                        // decoded key names of the segments
+} json_path_t;
+
+typedef struct json_shape_step {
+    int index;                                               // resolved key or element token, -1 when unresolved
+    int parent_size;                                         // child count of the containing object or array
+    json_token_offset_t parent_start;                        // offsets of the containing object or array
+    json_token_offset_t parent_end;
+    json_token_offset_t start;                               // offsets of the key or element token
+    json_token_offset_t end;
+} json_shape_step_t;
+
+typedef struct json_shape_entry {
+    const json_path_t *path;
+    json_shape_step_t steps[JSON_PATH_MAX_SEGMENTS];         // the token each segment resolved to and where it was
+} json_shape_entry_t;
+
+typedef struct json_shape_cache {
+    int path_count;
+    unsigned int hits;                                       // lookups answered from the cache
+    unsigned int misses;                                     // lookups that needed a full search
+    json_shape_entry_t entries[JSON_SHAPE_CACHE_MAX_PATHS];
+} json_shape_cache_t;
+
+typedef struct json_string_view {
+    const char *ptr;                                         // first character of the value in the JSON string
+    size_t len;                                              // number of characters, not NUL terminated
+} json_string_view_t;
+
+typedef enum {
+    JSON_FIELD_STRING,                                       // value is a char ** set to an allocated string
+    JSON_FIELD_INT,                                          // value is an int *
+    JSON_FIELD_DOUBLE,                                       // value is a double *
+    JSON_FIELD_BOOL,                                         // value is a bool *
+    JSON_FIELD_INDEX,                                        // value is an int * set to the value token index
+    JSON_FIELD_VIEW,                                         // value is a json_string_view_t * into the JSON string
+} json_field_type_t;
+
+typedef struct json_field {
+    const char *key;                                         // key name or dot delimited name path
+    json_field_type_t type;
+    void *value;                                             // destination for the value
+    bool found;                                              // set when the value was stored
+    int status;                                              // JSON_ERR_NONE or the JSONErrorCode for this field
+} json_field_t;
+
+typedef struct json_stream {
+    jsmn_parser parser;
+    char *buffer;                                            // buffered input, NUL terminated
+    size_t length;                                           // number of buffered characters
+    size_t capacity;
+    json_token_t *tokens;                                    // tokens of the completed document
+    unsigned int token_capacity;                             // capacity in jsmntok_t, the buffer jsmn parses into
+    int token_count;                                         // tokens in the completed document, 0 until complete
+    bool ended;                                              // no more input will be fed
+} json_stream_t;
+
+typedef int (*json_record_fn) (const char *json, size_t length, json_token_t *tokens, int token_count, void *context);
+
+typedef struct json_batch_stats {
+    int records;                                             // records passed to the callback
+    int errors;                                              // records that failed to parse
+    size_t bytes;                                            // bytes consumed from the buffer
+    uint64_t elapsed_us;
+    double records_per_second;
+    double bytes_per_second;
+} json_batch_stats_t;
+
+typedef struct json_document {
+    const char *json;
+    size_t length;
+    json_token_t *tokens;                                    // parsed tokens when no callback is given, free with json_free
+    int token_count;                                         // number of tokens or JSONErrorCode
+    int status;                                              // callback return value
+} json_document_t;
+
+typedef struct json_pool json_pool_t;
+
+// a tokenizer with the json_parse_tokens_grow signature, used by the pool to parse documents
+typedef int (*json_tokenize_fn) (jsmn_parser *parser, const char *json, size_t length, jsmntok_t **tokens, unsigned int *capacity);
+
+typedef struct json_file {
+    const char *json;                                        // read only mapping of the file, not NUL terminated
+    size_t length;                                           // file size in bytes
+    json_token_t *tokens;                                    // tokens from json_open_file, NULL after json_map_file
+    int token_count;
+} json_file_t;
+
+typedef struct json_iter {
+    json_token_t *tokens;
+    int container;                                           // index of the object or array token
+    int remaining;                                           // members or elements not yet produced
+    int next;                                                // index of the next key or element token
+} json_iter_t;
+
+#if defined(JSON_ENABLE_STATS)
+typedef struct json_stats {
+    uint64_t tokens_scanned;                                 // tokens stepped over by subtree walks, key searches and iterators
+    uint64_t key_compares;                                   // key tokens compared to a key name
+    uint64_t allocations;                                    // json_malloc and json_realloc calls
+    uint64_t allocated_bytes;                                // bytes requested from the allocator
+    uint64_t copied_bytes;                                   // bytes copied into strings, buffers and streams
+    uint64_t parses;                                         // tokenizer passes, one per document or parallel chunk
+    uint64_t parse_cycles;
+    uint64_t lookups;                                        // key and path lookups
+    uint64_t lookup_cycles;
+} json_stats_t;
+#endif
+
 int json_length (char *json);
 int json_token_count (jsmn_parser *parser, char *json);
-int json_parse_tokens (jsmn_parser *parser, char *json, jsmntok_t **tokens);
-
-int json_get_value_s(char *key, char **value, const char *json, jsmntok_t *tokens, int start_token);
-int json_get_index_s (int index, char **value, const char *json, jsmntok_t *tokens);
-int json_get_value_i (char *key, int *value, const char *json, jsmntok_t *tokens, int start_token);
-int json_get_index_i (int index, int *value, const char *json, jsmntok_t *tokens);
-int json_get_value_d (char *key, double *value, const char *json, jsmntok_t *tokens, int start_token);
-int json_get_index_d (int index, double *value, const char *json, jsmntok_t *tokens);
-int json_get_value_b (char *key, bool *value, const char *json, jsmntok_t *tokens, int start_token);
-int json_get_index_b (int index, bool *value, const char *json, jsmntok_t *tokens);
-
-int json_key_strcmp (const char *s, const char *json, jsmntok_t *tok);
-
-int json_last_object_token_index (jsmntok_t *tokens, int start_token);
-int json_last_array_token_index (jsmntok_t *tokens, int start_token);
-int json_root_object_indicies (jsmntok_t *tokens, int start_token, int **root_tokens);
-int json_root_array_indicies (jsmntok_t *tokens, int start_token, int **root_tokens);
-int json_root_key_index (jsmntok_t *tokens, int start_token, char *key, char *json);
+int json_estimate_token_count (const char *json, size_t length);
+int json_parse_tokens_into (jsmn_parser *parser, const char *json, size_t length, jsmntok_t *tokens, unsigned int capacity);
+int json_parse_tokens_grow (jsmn_parser *parser, const char *json, size_t length, jsmntok_t **tokens, unsigned int *capacity);
+int json_parse_tokens (jsmn_parser *parser, char *json, json_token_t **tokens);
+int json_parse_tokens_n (jsmn_parser *parser, const char *json, size_t length, json_token_t **tokens);
+int json_tokens_compact (jsmntok_t *tokens, int token_count, json_token_t **compact);
+int json_parse_tokens_structural (jsmn_parser *parser, const char *json, size_t length, json_token_t **tokens);
+int json_parse_tokens_structural_grow (jsmn_parser *parser, const char *json, size_t length, jsmntok_t **tokens, unsigned int *capacity);
+int json_parse_elements_structural_grow (jsmn_parser *parser, const char *json, size_t length, jsmntok_t **tokens, unsigned int *capacity);
+
+int json_stream_init (json_stream_t *stream);
+int json_feed (json_stream_t *stream, const char *chunk, size_t length);
+int json_feed_end (json_stream_t *stream);
+int json_stream_reset (json_stream_t *stream);
+void json_stream_free (json_stream_t *stream);
+
+int json_parse_uint64 (const char *start, const char *end, uint64_t *value);
+int json_parse_int64 (const char *start, const char *end, int64_t *value);
+int json_parse_double (const char *start, const char *end, double *value);
+int json_parse_fixed (const char *start, const char *end, int64_t *value, int scale_digits);
+
+int json_get_value_s(char *key, char **value, const char *json, json_token_t *tokens, int start_token);
+int json_get_index_s (int index, char **value, const char *json, json_token_t *tokens);
+int json_get_value_sv (char *key, json_string_view_t *value, const char *json, json_token_t *tokens, int start_token);
+int json_get_index_sv (int index, json_string_view_t *value, const char *json, json_token_t *tokens);
+int json_get_value_sn (char *key, char *buffer, size_t capacity, size_t *length, const char *json, json_token_t *tokens, int start_token);
+int json_get_index_sn (int index, char *buffer, size_t capacity, size_t *length, const char *json, json_token_t *tokens);
+int json_unescape (const char *src, size_t length, char *dst, size_t capacity, size_t *out_length);
+int json_unescape_scalar (const char *src, size_t length, char *dst, size_t capacity, size_t *out_length);
+int json_get_value_unescaped (char *key, char *buffer, size_t capacity, size_t *length, const char *json, json_token_t *tokens, int start_token);
+int json_get_index_unescaped (int index, char *buffer, size_t capacity, size_t *length, const char *json, json_token_t *tokens);
+int json_unescape_index (int index, json_string_view_t *value, char *json, json_token_t *tokens);
+int json_get_value_i (char *key, int *value, const char *json, json_token_t *tokens, int start_token);
+int json_get_index_i (int index, int *value, const char *json, json_token_t *tokens);
+int json_get_value_i64 (char *key, int64_t *value, const char *json, json_token_t *tokens, int start_token);
+int json_get_index_i64 (int index, int64_t *value, const char *json, json_token_t *tokens);
+int json_get_value_u64 (char *key, uint64_t *value, const char *json, json_token_t *tokens, int start_token);
+int json_get_index_u64 (int index, uint64_t *value, const char *json, json_token_t *tokens);
+int json_get_value_u32 (char *key, uint32_t *value, const char *json, json_token_t *tokens, int start_token);
+int json_get_index_u32 (int index, uint32_t *value, const char *json, json_token_t *tokens);
+int json_get_value_d (char *key, double *value, const char *json, json_token_t *tokens, int start_token);
+int json_get_index_d (int index, double *value, const char *json, json_token_t *tokens);
+int json_get_value_f (char *key, float *value, const char *json, json_token_t *tokens, int start_token);
+int json_get_index_f (int index, float *value, const char *json, json_token_t *tokens);
+int json_get_value_fixed (char *key, int64_t *value, int scale_digits, const char *json, json_token_t *tokens, int start_token);
+int json_get_index_fixed (int index, int64_t *value, int scale_digits, const char *json, json_token_t *tokens);
+int json_get_value_b (char *key, bool *value, const char *json, json_token_t *tokens, int start_token);
+int json_get_index_b (int index, bool *value, const char *json, json_token_t *tokens);
+int json_get_array_i32 (char *key, int32_t *values, size_t capacity, size_t *count, const char *json, json_token_t *tokens, int start_token);
+int json_get_array_i64 (char *key, int64_t *values, size_t capacity, size_t *count, const char *json, json_token_t *tokens, int start_token);
+int json_get_array_f64 (char *key, double *values, size_t capacity, size_t *count, const char *json, json_token_t *tokens, int start_token);
+int json_get_array_bool (char *key, bool *values, size_t capacity, size_t *count, const char *json, json_token_t *tokens, int start_token);
+
+uint32_t json_key_hash (const char *key, size_t length);
+int json_get_path_s (const json_path_t *path, char **value, const char *json, json_token_t *tokens, int start_token);
+int json_get_path_i (const json_path_t *path, int *value, const char *json, json_token_t *tokens, int start_token);
+int json_get_path_d (const json_path_t *path, double *value, const char *json, json_token_t *tokens, int start_token);
+int json_get_path_b (const json_path_t *path, bool *value, const char *json, json_token_t *tokens, int start_token);
+
+int json_key_strcmp (const char *s, const char *json, json_token_t *tok);
+
+int json_token_table_build (json_token_table_t *table, json_token_t *tokens, int token_count);
+void json_token_table_free (json_token_table_t *table);
+void json_token_table_attach (json_token_table_t *table);
+void json_token_table_release (const void *tokens);
+
+int json_last_token_index (json_token_t *tokens, int start_token);
+int json_last_object_token_index (json_token_t *tokens, int start_token);
+int json_last_array_token_index (json_token_t *tokens, int start_token);
+int json_iter_begin (json_iter_t *it, json_token_t *tokens, int index);
+int json_iter_next (json_iter_t *it, int *key_token, int *value_token);
+int json_root_object_indicies (json_token_t *tokens, int start_token, int **root_tokens);
+int json_root_array_indicies (json_token_t *tokens, int start_token, int **root_tokens);
+int json_root_key_index (json_token_t *tokens, int start_token, char *key, char *json);
 char * json_get_key_dot (const char *key, int start_chr);
-int json_key_index (jsmntok_t *tokens, int start_token, char *key, char *json);
+int json_key_index (json_token_t *tokens, int start_token, char *key, char *json);
+int json_value_index (json_token_t *tokens, int start_token, char *key, char *json);
+int json_table_key_index (json_token_table_t *table, int start_token, char *key, char *json);
+int json_table_value_index (json_token_table_t *table, int start_token, char *key, char *json);
+int json_path_compile (const char *key, json_path_t *path);
+int json_path_lookup (const json_path_t *path, const char *json, json_token_t *tokens, int start_token);
+int json_path_value_index (const json_path_t *path, const char *json, json_token_t *tokens, int start_token);
+int json_get_fields (json_field_t *fields, int field_count, const char *json, json_token_t *tokens, int start_token, uint64_t *elapsed_us);
+int json_shape_cache_init (json_shape_cache_t *cache, const json_path_t *paths, int path_count);
+int json_shape_key_index (json_shape_cache_t *cache, int path_index, const char *json, json_token_t *tokens, int token_count);
+int json_scan_value (const char *json, size_t length, const char *key, json_string_view_t *value);
+int json_parse_tokens_selected (const json_path_t *paths, int path_count, const char *json, size_t length, json_token_t **tokens);
+int json_parse_batch (const char *json, size_t length, json_record_fn callback, void *context, json_batch_stats_t *stats);
+
+#if defined(JSON_ENABLE_THREADS)
+json_pool_t * json_pool_create (int thread_count);
+int json_pool_parse (json_pool_t *pool, json_document_t *documents, int document_count, json_record_fn callback, void *context);
+int json_pool_parse_with (json_pool_t *pool, json_document_t *documents, int document_count, json_tokenize_fn tokenize, json_record_fn callback, void *context);
+int json_pool_size (json_pool_t *pool);
+void json_pool_free (json_pool_t *pool);
+int json_parse_array_parallel (json_pool_t *pool, const char *json, size_t length, json_token_t **tokens);
+#endif
+
+#if defined(JSON_ENABLE_FILES)
+int json_map_file (const char *path, json_file_t *file);
+int json_open_file (const char *path, json_file_t *file);
+void json_close_file (json_file_t *file);
+#endif
+
+#if defined(JSON_ENABLE_STATS)
+void json_stats_get (json_stats_t *stats);
+void json_stats_reset (void);
+#endif
 
 const char * json_error_string (JSONErrorCode result);
 
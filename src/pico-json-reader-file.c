@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <string.h>
+#include "pico-json-reader.h"
+
+#if defined(JSON_ENABLE_FILES)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/**
+ * Map a file read only into memory without reading it into the heap. Pages are loaded by
+ * the operating system as they are first touched, so the contents can be passed to the
+ * length explicit functions such as json_parse_tokens_n, json_parse_batch and json_scan_value
+ * without a copy. The mapping is not NUL terminated and may be larger than JSON_TOKEN_OFFSET_MAX.
+ * NOTE: The caller is responsible for unmapping the file with json_close_file.
+ *
+ * @param path The path of the file to map.
+ * @param file The file to set to the mapping, its tokens are set to NULL.
+ * @return JSON_ERR_NONE on success, JSON_ERR_RANGE if the file does not fit the address space, JSONErrorCode on failure.
+ */
+int json_map_file (const char *path, json_file_t *file) {
+  if (!path || !file) return JSON_ERR_INVALID;
+  memset(file, 0, sizeof(*file));
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return JSON_ERR_INVALID;
+  struct stat info;
+  if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size <= 0) {
+    close(fd);
+    return JSON_ERR_INVALID;
+  }
+  if ((off_t)(size_t)info.st_size != info.st_size) {
+    close(fd);
+    return JSON_ERR_RANGE;
+  }
+  void *mapped = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping holds its own reference to the file
+  close(fd);
+  if (mapped == MAP_FAILED) return JSON_ERR_MEMORY;
+  file->json = mapped;
+  file->length = (size_t)info.st_size;
+  return JSON_ERR_NONE;
+}
+
+
+/**
+ * Map a file read only and tokenize it in place with json_parse_tokens_structural. The
+ * tokens index into file->json, which stays mapped until json_close_file.
+ * NOTE: The caller is responsible for releasing the mapping and tokens with json_close_file.
+ * NOTE: Files over 2 GB need JSON_WIDE_TOKENS, whose tokens hold 48 bit offsets.
+ *
+ * @param path The path of the JSON file.
+ * @param file The file to set to the mapping and its tokens.
+ * @return The number of tokens, JSON_ERR_RANGE if the file is longer than JSON_STRUCTURAL_OFFSET_MAX, or JSONErrorCode on failure.
+ */
+int json_open_file (const char *path, json_file_t *file) {
+  int err = json_map_file(path, file);
+  if (err != JSON_ERR_NONE) return err;
+  if (file->length > JSON_STRUCTURAL_OFFSET_MAX) {
+    json_close_file(file);
+    return JSON_ERR_RANGE;
+  }
+  // the tokenizer reads the file front to back once
+  madvise((void *)file->json, file->length, MADV_SEQUENTIAL);
+  jsmn_parser parser;
+  int token_count = json_parse_tokens_structural(&parser, file->json, file->length, &file->tokens);
+  if (token_count <= 0) {
+    json_close_file(file);
+    return token_count < 0 ? token_count : JSON_ERR_INVALID;
+  }
+  file->token_count = token_count;
+  return token_count;
+}
+
+
+/**
+ * Free the tokens of a file and unmap it.
+ *
+ * @param file The file from json_map_file or json_open_file.
+ */
+void json_close_file (json_file_t *file) {
+  if (!file) return;
+  json_free(file->tokens);
+  if (file->json != NULL) munmap((void *)file->json, file->length);
+  memset(file, 0, sizeof(*file));
+}
+
+#endif
@@ -0,0 +1,251 @@
+#include <stdlib.h>
+#include <string.h>
+#include "pico-json-reader.h"
+
+#if defined(JSON_ENABLE_THREADS)
+#include <pthread.h>
+#include <stdatomic.h>
+
+
+typedef struct json_pool_worker {
+  pthread_t thread;
+  struct json_pool *pool;
+  int id;
+  atomic_int next;                                           // next document in this worker's range, other workers steal from it
+  int end;
+  jsmn_parser parser;
+  jsmntok_t *tokens;                                         // scratch tokens reused for callback documents
+  unsigned int token_capacity;
+  json_arena_t arena;                                        // scratch memory for the callback, reset per document
+  json_allocator_t arena_allocator;
+  unsigned char *arena_buffer;
+} json_pool_worker_t;
+
+struct json_pool {
+  const json_allocator_t *allocator;                         // the allocator active when the pool was created
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  unsigned int generation;                                   // incremented for every job
+  int running;                                               // workers still processing the current job
+  bool shutdown;
+  json_document_t *documents;
+  json_tokenize_fn tokenize;
+  json_record_fn callback;
+  void *context;
+  atomic_int parsed;
+  int worker_count;
+  json_pool_worker_t workers[];
+};
+
+
+// parse one document, keeping the tokens or passing them to the callback
+static void json_pool_document (json_pool_worker_t *worker, json_document_t *document) {
+  json_pool_t *pool = worker->pool;
+  jsmn_init(&worker->parser);
+  if (pool->callback == NULL) {
+    unsigned int capacity = 0;
+    jsmntok_t *parsed = NULL;
+    document->tokens = NULL;
+    document->token_count = pool->tokenize(&worker->parser, document->json, document->length, &parsed, &capacity);
+    document->status = 0;
+    int err = document->token_count > 0 ? json_tokens_compact(parsed, document->token_count, &document->tokens) : JSON_ERR_INVALID;
+    if (err != JSON_ERR_NONE) {
+      json_free(parsed);
+      document->tokens = NULL;
+      if (document->token_count >= 0) document->token_count = err;
+      return;
+    }
+#if defined(JSON_COMPACT_TOKENS)
+    // return the memory freed by compacting
+    json_token_t *shrunk = json_realloc(document->tokens, sizeof(json_token_t) * document->token_count);
+    if (shrunk != NULL) document->tokens = shrunk;
+#endif
+    atomic_fetch_add(&pool->parsed, 1);
+    return;
+  }
+  document->tokens = NULL;
+  document->token_count = pool->tokenize(&worker->parser, document->json, document->length, &worker->tokens, &worker->token_capacity);
+  // the scratch tokens are compacted in place and parsed into again by the next document
+  json_token_t *tokens = NULL;
+  int err = document->token_count > 0 ? json_tokens_compact(worker->tokens, document->token_count, &tokens) : JSON_ERR_INVALID;
+  if (err != JSON_ERR_NONE) {
+    if (document->token_count >= 0) document->token_count = err;
+    document->status = 0;
+    return;
+  }
+  atomic_fetch_add(&pool->parsed, 1);
+  // allocations made by the callback come from the worker's arena
+  json_arena_reset(&worker->arena);
+  json_set_allocator(&worker->arena_allocator);
+  document->status = pool->callback(document->json, document->length, tokens, document->token_count, pool->context);
+  json_set_allocator(pool->allocator);
+}
+
+
+// process the worker's own range, then steal from the ranges of the other workers
+static void json_pool_run (json_pool_worker_t *worker) {
+  json_pool_t *pool = worker->pool;
+  for (int k = 0; k < pool->worker_count; k++) {
+    json_pool_worker_t *victim = &pool->workers[(worker->id + k) % pool->worker_count];
+    int index;
+    while ((index = atomic_fetch_add(&victim->next, 1)) < victim->end) {
+      json_pool_document(worker, &pool->documents[index]);
+    }
+  }
+}
+
+
+static void * json_pool_thread (void *argument) {
+  json_pool_worker_t *worker = argument;
+  json_pool_t *pool = worker->pool;
+  json_set_allocator(pool->allocator);
+  unsigned int seen = 0;
+  pthread_mutex_lock(&pool->lock);
+  while (true) {
+    while (pool->generation == seen && !pool->shutdown) pthread_cond_wait(&pool->start, &pool->lock);
+    if (pool->shutdown) break;
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+    json_pool_run(worker);
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->running == 0) pthread_cond_signal(&pool->done);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+
+/**
+ * Create a pool of worker threads for parsing many independent documents concurrently.
+ * Each worker has its own parser, scratch token buffer and scratch arena of JSON_POOL_ARENA_SIZE
+ * bytes. The pool and the tokens it returns use the allocator active on the calling thread,
+ * which must be safe to use from several threads.
+ *
+ * @param thread_count The number of worker threads.
+ * @return The pool, or NULL on failure.
+ */
+json_pool_t * json_pool_create (int thread_count) {
+  if (thread_count <= 0) return NULL;
+  json_pool_t *pool = json_malloc(sizeof(json_pool_t) + sizeof(json_pool_worker_t) * thread_count);
+  if (pool == NULL) return NULL;
+  memset(pool, 0, sizeof(json_pool_t) + sizeof(json_pool_worker_t) * thread_count);
+  pool->allocator = json_get_allocator();
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->start, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  for (int i = 0; i < thread_count; i++) {
+    json_pool_worker_t *worker = &pool->workers[i];
+    worker->pool = pool;
+    worker->id = i;
+    atomic_init(&worker->next, 0);
+    worker->arena_buffer = json_malloc(JSON_POOL_ARENA_SIZE);
+    if (worker->arena_buffer == NULL || pthread_create(&worker->thread, NULL, json_pool_thread, worker) != 0) {
+      json_free(worker->arena_buffer);
+      pool->worker_count = i;
+      json_pool_free(pool);
+      return NULL;
+    }
+    json_arena_init(&worker->arena, &worker->arena_allocator, worker->arena_buffer, JSON_POOL_ARENA_SIZE);
+    pool->worker_count = i + 1;
+  }
+  return pool;
+}
+
+
+/**
+ * Parse documents concurrently on the pool with the structural indexer backend. The documents
+ * are split into one range per worker and a worker that finishes its range steals documents
+ * from the others.
+ * Without a callback each document is given its own token array, freed with json_free.
+ * With a callback the tokens are parsed into the worker's scratch buffer and passed to the
+ * callback on the worker thread, memory the callback allocates with the reader comes from the
+ * worker's arena and is reclaimed after the callback returns. The callback return value is
+ * stored in the document status.
+ *
+ * @param pool The pool from json_pool_create.
+ * @param documents The documents, json and length must be set.
+ * @param document_count The number of documents.
+ * @param callback Optional, called on a worker thread with each parsed document and the context.
+ * @param context Passed to the callback.
+ * @return The number of documents parsed, or JSONErrorCode on failure.
+ */
+int json_pool_parse (json_pool_t *pool, json_document_t *documents, int document_count, json_record_fn callback, void *context) {
+  return json_pool_parse_with(pool, documents, document_count, json_parse_tokens_structural_grow, callback, context);
+}
+
+
+/**
+ * Parse documents concurrently on the pool like json_pool_parse with the given tokenizer,
+ * i.e. json_parse_tokens_grow for jsmn or json_parse_elements_structural_grow for array parts.
+ *
+ * @param pool The pool from json_pool_create.
+ * @param documents The documents, json and length must be set.
+ * @param document_count The number of documents.
+ * @param tokenize The tokenizer, called on a worker thread with the worker's initialized parser.
+ * @param callback Optional, called on a worker thread with each parsed document and the context.
+ * @param context Passed to the callback.
+ * @return The number of documents parsed, or JSONErrorCode on failure.
+ */
+int json_pool_parse_with (json_pool_t *pool, json_document_t *documents, int document_count, json_tokenize_fn tokenize, json_record_fn callback, void *context) {
+  if (!pool || (!documents && document_count > 0) || document_count < 0 || !tokenize) return JSON_ERR_INVALID;
+  if (document_count == 0) return 0;
+  pthread_mutex_lock(&pool->lock);
+  pool->documents = documents;
+  pool->tokenize = tokenize;
+  pool->callback = callback;
+  pool->context = context;
+  atomic_store(&pool->parsed, 0);
+  for (int i = 0; i < pool->worker_count; i++) {
+    json_pool_worker_t *worker = &pool->workers[i];
+    atomic_store(&worker->next, (int)((int64_t)document_count * i / pool->worker_count));
+    worker->end = (int)((int64_t)document_count * (i + 1) / pool->worker_count);
+  }
+  pool->running = pool->worker_count;
+  pool->generation += 1;
+  pthread_cond_broadcast(&pool->start);
+  while (pool->running > 0) pthread_cond_wait(&pool->done, &pool->lock);
+  pool->documents = NULL;
+  pthread_mutex_unlock(&pool->lock);
+  return atomic_load(&pool->parsed);
+}
+
+
+/**
+ * Get the number of worker threads in the pool.
+ *
+ * @param pool The pool from json_pool_create.
+ * @return The number of worker threads.
+ */
+int json_pool_size (json_pool_t *pool) {
+  return pool ? pool->worker_count : 0;
+}
+
+
+/**
+ * Stop the worker threads and free the pool.
+ *
+ * @param pool The pool to free, may be NULL.
+ */
+void json_pool_free (json_pool_t *pool) {
+  if (pool == NULL) return;
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown = true;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+  const json_allocator_t *allocator = json_get_allocator();
+  json_set_allocator(pool->allocator);
+  for (int i = 0; i < pool->worker_count; i++) {
+    json_pool_worker_t *worker = &pool->workers[i];
+    pthread_join(worker->thread, NULL);
+    json_free(worker->tokens);
+    json_free(worker->arena_buffer);
+  }
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->start);
+  pthread_cond_destroy(&pool->done);
+  json_free(pool);
+  json_set_allocator(allocator);
+}
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef PICO_JSON_READER_STATS_H
+#define PICO_JSON_READER_STATS_H
+
+// hot path counters, compiled out unless JSON_ENABLE_STATS is defined
+#if defined(JSON_ENABLE_STATS)
+
+#if !defined(LIB_PICO_STDLIB) && !defined(__x86_64__) && !defined(__i386__) && !defined(__aarch64__)
+#include <time.h>
+#endif
+
+#if defined(JSON_STATS_PER_THREAD)
+extern JSON_THREAD_LOCAL json_stats_t json_stats_counters;
+#else
+extern json_stats_t json_stats_counters;
+#endif
+
+// shared counters are updated atomically when other threads may be parsing
+#if defined(JSON_ENABLE_THREADS) && !defined(JSON_STATS_PER_THREAD)
+#define JSON_STATS_ADD(counter, count) __atomic_fetch_add(&json_stats_counters.counter, (uint64_t)(count), __ATOMIC_RELAXED)
+#else
+#define JSON_STATS_ADD(counter, count) (json_stats_counters.counter += (uint64_t)(count))
+#endif
+
+// cycle counter on x86, virtual counter ticks on arm64, otherwise the finest clock available
+static inline uint64_t json_stats_cycles (void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+  uint64_t ticks;
+  __asm__ volatile ("mrs %0, cntvct_el0" : "=r" (ticks));
+  return ticks;
+#elif defined(LIB_PICO_STDLIB)
+  return time_us_64();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+#define JSON_STATS_START(name) uint64_t name = json_stats_cycles()
+#define JSON_STATS_STOP(counter, name) JSON_STATS_ADD(counter, json_stats_cycles() - (name))
+
+#else
+
+#define JSON_STATS_ADD(counter, count) ((void)0)
+#define JSON_STATS_START(name) ((void)0)
+#define JSON_STATS_STOP(counter, name) ((void)0)
+
+#endif
+
+#endif
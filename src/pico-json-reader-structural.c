@@ -0,0 +1,658 @@
+#include <stdlib.h>
+#include <string.h>
+#define JSMN_HEADER                                          // declarations only, jsmn is defined with the reader
+#include "jsmn.h"
+#include "pico-json-reader.h"
+#include "pico-json-reader-stats.h"
+
+// JSON_STRUCTURAL_SCALAR selects the portable classifier on any target
+#if defined(JSON_STRUCTURAL_SCALAR)
+#elif defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define JSON_STRUCTURAL_X86 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define JSON_STRUCTURAL_NEON 1
+#endif
+
+
+// masks for one 64 character block, bit i is set when character i is in the class
+typedef struct json_block_masks {
+  uint64_t quote;
+  uint64_t backslash;
+  uint64_t op;
+  uint64_t space;
+} json_block_masks_t;
+
+typedef void (*json_classify_fn) (const char *block, json_block_masks_t *masks);
+
+// stage 2 expectations
+typedef enum {
+  JSON_EXPECT_VALUE,
+  JSON_EXPECT_VALUE_OR_CLOSE,
+  JSON_EXPECT_KEY,
+  JSON_EXPECT_KEY_OR_CLOSE,
+  JSON_EXPECT_COLON,
+  JSON_EXPECT_NEXT,
+  JSON_EXPECT_NOTHING
+} json_expect_t;
+
+#if defined(JSON_WIDE_TOKENS)
+// offsets past INT_MAX are kept until the tokens are packed into json_token_t
+typedef struct json_structural_token {
+  jsmntype_t type;
+  int64_t start;
+  int64_t end;
+  int size;
+} json_structural_token_t;
+#else
+typedef jsmntok_t json_structural_token_t;
+#endif
+
+typedef struct json_structural_frame {
+  int container;                                             // token index of the open object or array
+  int key;                                                   // token index of the current key in an object
+} json_structural_frame_t;
+
+typedef struct json_structural {
+  const char *json;
+  size_t length;
+  json_structural_token_t *tokens;
+  unsigned int count;
+  unsigned int capacity;
+  json_structural_frame_t stack[JSON_STRUCTURAL_MAX_DEPTH];
+  int depth;
+  json_expect_t expect;
+  long string_open;                                          // position of an open quote, -1 outside strings
+  bool string_is_key;
+  bool fallback;                                             // input jsmn may treat differently, parse with jsmn
+  bool memory;                                               // token allocation failed
+  bool elements;                                             // the input is the elements of a root array token
+} json_structural_t;
+
+
+#if !defined(JSON_STRUCTURAL_X86) && !defined(JSON_STRUCTURAL_NEON)
+static void json_classify_scalar (const char *block, json_block_masks_t *masks) {
+  uint64_t quote = 0, backslash = 0, op = 0, space = 0;
+  for (int i = 0; i < 64; i++) {
+    uint64_t bit = (uint64_t)1 << i;
+    switch (block[i]) {
+      case '"': quote |= bit; break;
+      case '\\': backslash |= bit; break;
+      case '{': case '}': case '[': case ']': case ',': case ':': op |= bit; break;
+      case ' ': case '\t': case '\n': case '\r': space |= bit; break;
+      default: break;
+    }
+  }
+  masks->quote = quote;
+  masks->backslash = backslash;
+  masks->op = op;
+  masks->space = space;
+}
+#endif
+
+
+#if defined(JSON_STRUCTURAL_X86)
+static void json_classify_sse2 (const char *block, json_block_masks_t *masks) {
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i comma = _mm_set1_epi8(',');
+  const __m128i colon = _mm_set1_epi8(':');
+  const __m128i open = _mm_set1_epi8('[');                  // '[' | 0x20 == '{'
+  const __m128i close = _mm_set1_epi8(']');                 // ']' | 0x20 == '}'
+  const __m128i lower = _mm_set1_epi8(0x20);
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i newline = _mm_set1_epi8('\n');
+  const __m128i carriage = _mm_set1_epi8('\r');
+  memset(masks, 0, sizeof(*masks));
+  for (int i = 0; i < 4; i++) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)(block + i * 16));
+    __m128i folded = _mm_andnot_si128(lower, chunk);
+    __m128i op = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(chunk, comma), _mm_cmpeq_epi8(chunk, colon)),
+      _mm_or_si128(_mm_cmpeq_epi8(folded, open), _mm_cmpeq_epi8(folded, close)));
+    __m128i ws = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab)),
+      _mm_or_si128(_mm_cmpeq_epi8(chunk, newline), _mm_cmpeq_epi8(chunk, carriage)));
+    int shift = i * 16;
+    masks->quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, quote)) << shift;
+    masks->backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, backslash)) << shift;
+    masks->op |= (uint64_t)(uint16_t)_mm_movemask_epi8(op) << shift;
+    masks->space |= (uint64_t)(uint16_t)_mm_movemask_epi8(ws) << shift;
+  }
+}
+
+
+__attribute__((target("avx2")))
+static void json_classify_avx2 (const char *block, json_block_masks_t *masks) {
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i backslash = _mm256_set1_epi8('\\');
+  const __m256i comma = _mm256_set1_epi8(',');
+  const __m256i colon = _mm256_set1_epi8(':');
+  const __m256i open = _mm256_set1_epi8('[');
+  const __m256i close = _mm256_set1_epi8(']');
+  const __m256i lower = _mm256_set1_epi8(0x20);
+  const __m256i space = _mm256_set1_epi8(' ');
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i newline = _mm256_set1_epi8('\n');
+  const __m256i carriage = _mm256_set1_epi8('\r');
+  memset(masks, 0, sizeof(*masks));
+  for (int i = 0; i < 2; i++) {
+    __m256i chunk = _mm256_loadu_si256((const __m256i *)(block + i * 32));
+    __m256i folded = _mm256_andnot_si256(lower, chunk);
+    __m256i op = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(chunk, comma), _mm256_cmpeq_epi8(chunk, colon)),
+      _mm256_or_si256(_mm256_cmpeq_epi8(folded, open), _mm256_cmpeq_epi8(folded, close)));
+    __m256i ws = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(chunk, space), _mm256_cmpeq_epi8(chunk, tab)),
+      _mm256_or_si256(_mm256_cmpeq_epi8(chunk, newline), _mm256_cmpeq_epi8(chunk, carriage)));
+    int shift = i * 32;
+    masks->quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, quote)) << shift;
+    masks->backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, backslash)) << shift;
+    masks->op |= (uint64_t)(uint32_t)_mm256_movemask_epi8(op) << shift;
+    masks->space |= (uint64_t)(uint32_t)_mm256_movemask_epi8(ws) << shift;
+  }
+}
+#elif defined(JSON_STRUCTURAL_NEON)
+// collapse a 16 lane comparison into a 16 bit mask
+static uint64_t json_neon_movemask (uint8x16_t match) {
+  static const uint8_t bits[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+  uint8x16_t masked = vandq_u8(match, vld1q_u8(bits));
+  uint8x8_t low = vget_low_u8(masked);
+  uint8x8_t high = vget_high_u8(masked);
+  low = vpadd_u8(low, low);
+  low = vpadd_u8(low, low);
+  low = vpadd_u8(low, low);
+  high = vpadd_u8(high, high);
+  high = vpadd_u8(high, high);
+  high = vpadd_u8(high, high);
+  return (uint64_t)vget_lane_u8(low, 0) | ((uint64_t)vget_lane_u8(high, 0) << 8);
+}
+
+
+static void json_classify_neon (const char *block, json_block_masks_t *masks) {
+  memset(masks, 0, sizeof(*masks));
+  for (int i = 0; i < 4; i++) {
+    uint8x16_t chunk = vld1q_u8((const uint8_t *)block + i * 16);
+    uint8x16_t folded = vbicq_u8(chunk, vdupq_n_u8(0x20));
+    uint8x16_t op = vorrq_u8(
+      vorrq_u8(vceqq_u8(chunk, vdupq_n_u8(',')), vceqq_u8(chunk, vdupq_n_u8(':'))),
+      vorrq_u8(vceqq_u8(folded, vdupq_n_u8('[')), vceqq_u8(folded, vdupq_n_u8(']'))));
+    uint8x16_t ws = vorrq_u8(
+      vorrq_u8(vceqq_u8(chunk, vdupq_n_u8(' ')), vceqq_u8(chunk, vdupq_n_u8('\t'))),
+      vorrq_u8(vceqq_u8(chunk, vdupq_n_u8('\n')), vceqq_u8(chunk, vdupq_n_u8('\r'))));
+    int shift = i * 16;
+    masks->quote |= json_neon_movemask(vceqq_u8(chunk, vdupq_n_u8('"'))) << shift;
+    masks->backslash |= json_neon_movemask(vceqq_u8(chunk, vdupq_n_u8('\\'))) << shift;
+    masks->op |= json_neon_movemask(op) << shift;
+    masks->space |= json_neon_movemask(ws) << shift;
+  }
+}
+#endif
+
+
+// select the widest classifier supported by the running CPU
+static json_classify_fn json_classifier (void) {
+#if defined(JSON_STRUCTURAL_X86)
+  static JSON_THREAD_LOCAL json_classify_fn classify = NULL;
+  if (classify == NULL) {
+    __builtin_cpu_init();
+    classify = __builtin_cpu_supports("avx2") ? json_classify_avx2 : json_classify_sse2;
+  }
+  return classify;
+#elif defined(JSON_STRUCTURAL_NEON)
+  return json_classify_neon;
+#else
+  return json_classify_scalar;
+#endif
+}
+
+
+// mark every bit after an odd number of quote bits, i.e. the inside of strings
+static uint64_t json_prefix_xor (uint64_t bits) {
+  bits ^= bits << 1;
+  bits ^= bits << 2;
+  bits ^= bits << 4;
+  bits ^= bits << 8;
+  bits ^= bits << 16;
+  bits ^= bits << 32;
+  return bits;
+}
+
+
+static int json_ctz64 (uint64_t bits) {
+  return __builtin_ctzll(bits);
+}
+
+
+// check an escape sequence the same way jsmn does, position is the backslash
+static bool json_structural_escape_valid (const char *json, size_t length, size_t position) {
+  if (position + 1 >= length) return false;
+  switch (json[position + 1]) {
+    case '"': case '/': case '\\': case 'b': case 'f': case 'r': case 'n': case 't':
+      return true;
+    case 'u':
+      if (position + 6 > length) return false;
+      for (size_t i = position + 2; i < position + 6; i++) {
+        char c = json[i];
+        if (!((c >= '0' && c <= '9') || (c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f'))) return false;
+      }
+      return true;
+    default:
+      return false;
+  }
+}
+
+
+// allocate the next token
+static json_structural_token_t * json_structural_token (json_structural_t *state, jsmntype_t type, int64_t start, int64_t end) {
+  if (state->count == state->capacity) {
+    unsigned int grown = state->capacity * 2;
+    json_structural_token_t *tmp = json_realloc(state->tokens, sizeof(json_structural_token_t) * grown);
+    if (tmp == NULL) {
+      state->memory = true;
+      return NULL;
+    }
+    state->tokens = tmp;
+    state->capacity = grown;
+  }
+  json_structural_token_t *tok = &state->tokens[state->count++];
+  tok->type = type;
+  tok->start = start;
+  tok->end = end;
+  tok->size = 0;
+  return tok;
+}
+
+
+// count a new value in its parent, the key for object values as jsmn does
+static void json_structural_value (json_structural_t *state) {
+  if (state->depth == 0) return;
+  json_structural_frame_t *frame = &state->stack[state->depth - 1];
+  if (state->tokens[frame->container].type == JSMN_OBJECT) state->tokens[frame->key].size += 1;
+  else state->tokens[frame->container].size += 1;
+}
+
+
+// the expectation after a complete value
+static void json_structural_value_done (json_structural_t *state) {
+  state->expect = state->depth ? JSON_EXPECT_NEXT : JSON_EXPECT_NOTHING;
+}
+
+
+static bool json_structural_expects_value (json_structural_t *state) {
+  return state->expect == JSON_EXPECT_VALUE || state->expect == JSON_EXPECT_VALUE_OR_CLOSE;
+}
+
+
+// stage 2, consume the next structural position and emit tokens like jsmn
+static void json_structural_step (json_structural_t *state, size_t position) {
+  char c = state->json[position];
+  if (state->string_open >= 0) {
+    // the next structural after an open quote is always the closing quote
+    json_structural_token_t *tok = json_structural_token(state, JSMN_STRING, state->string_open + 1, position);
+    if (tok == NULL) return;
+    if (state->string_is_key) {
+      json_structural_frame_t *frame = &state->stack[state->depth - 1];
+      state->tokens[frame->container].size += 1;
+      frame->key = state->count - 1;
+      state->expect = JSON_EXPECT_COLON;
+    }
+    else {
+      json_structural_value(state);
+      json_structural_value_done(state);
+    }
+    state->string_open = -1;
+    return;
+  }
+  switch (c) {
+    case '"':
+      if (state->expect == JSON_EXPECT_KEY || state->expect == JSON_EXPECT_KEY_OR_CLOSE) {
+        state->string_is_key = true;
+      }
+      else if (json_structural_expects_value(state)) {
+        state->string_is_key = false;
+      }
+      else {
+        state->fallback = true;
+        return;
+      }
+      state->string_open = position;
+      return;
+    case '{':
+    case '[': {
+      if (!json_structural_expects_value(state) || state->depth == JSON_STRUCTURAL_MAX_DEPTH) {
+        state->fallback = true;
+        return;
+      }
+      json_structural_value(state);
+      if (json_structural_token(state, c == '{' ? JSMN_OBJECT : JSMN_ARRAY, position, -1) == NULL) return;
+      json_structural_frame_t *frame = &state->stack[state->depth++];
+      frame->container = state->count - 1;
+      frame->key = -1;
+      state->expect = c == '{' ? JSON_EXPECT_KEY_OR_CLOSE : JSON_EXPECT_VALUE_OR_CLOSE;
+      return;
+    }
+    case '}':
+    case ']': {
+      if (state->depth == (state->elements ? 1 : 0)) {
+        state->fallback = true;
+        return;
+      }
+      json_structural_token_t *container = &state->tokens[state->stack[state->depth - 1].container];
+      bool object = c == '}';
+      bool can_close = state->expect == JSON_EXPECT_NEXT ||
+        (object && state->expect == JSON_EXPECT_KEY_OR_CLOSE) ||
+        (!object && state->expect == JSON_EXPECT_VALUE_OR_CLOSE);
+      if (!can_close || container->type != (object ? JSMN_OBJECT : JSMN_ARRAY)) {
+        state->fallback = true;
+        return;
+      }
+      container->end = position + 1;
+      state->depth -= 1;
+      json_structural_value_done(state);
+      return;
+    }
+    case ',':
+      if (state->expect != JSON_EXPECT_NEXT) {
+        state->fallback = true;
+        return;
+      }
+      state->expect = state->tokens[state->stack[state->depth - 1].container].type == JSMN_OBJECT ? JSON_EXPECT_KEY : JSON_EXPECT_VALUE;
+      return;
+    case ':':
+      if (state->expect != JSON_EXPECT_COLON) {
+        state->fallback = true;
+        return;
+      }
+      state->expect = JSON_EXPECT_VALUE;
+      return;
+    default: {
+      // a primitive ends where jsmn ends it, any character jsmn would treat differently falls back
+      if (!json_structural_expects_value(state)) {
+        state->fallback = true;
+        return;
+      }
+      size_t end = position;
+      for (; end < state->length; end++) {
+        char p = state->json[end];
+        if (p == ' ' || p == '\t' || p == '\n' || p == '\r' || p == ',' || p == ']' || p == '}' || p == ':') break;
+        if (p < 32 || p >= 127 || p == '"' || p == '{' || p == '[' || p == '\\') {
+          state->fallback = true;
+          return;
+        }
+      }
+      json_structural_value(state);
+      if (json_structural_token(state, JSMN_PRIMITIVE, position, end) == NULL) return;
+      json_structural_value_done(state);
+      return;
+    }
+  }
+}
+
+
+// parse into a token buffer grown as needed, with elements the input is the comma separated
+// elements of an array and the tokens start with a root array token spanning the input,
+// wide token builds return 0 for input that must be parsed with jsmn
+static int json_structural_parse (jsmn_parser *parser, const char *json, size_t length, json_structural_token_t **tokens, unsigned int *capacity, bool elements) {
+  if (!parser || !json || !tokens || !capacity) return JSON_ERR_INVALID;
+  if (length > JSON_STRUCTURAL_OFFSET_MAX) return JSON_ERR_RANGE;
+  // jsmn stops at a NUL character
+  const char *nul = memchr(json, '\0', length);
+  if (nul != NULL) length = nul - json;
+  if (length == 0) return JSON_ERR_INVALID;
+  JSON_STATS_START(start);
+
+  json_token_table_release(*tokens);
+  if (*tokens == NULL || *capacity == 0) {
+    size_t estimate = length / 8 + JSON_MIN_TOKEN_CAPACITY;
+    *capacity = *capacity ? *capacity : estimate < JSON_STRUCTURAL_MAX_INITIAL_TOKENS ? estimate : JSON_STRUCTURAL_MAX_INITIAL_TOKENS;
+    *tokens = json_malloc(sizeof(json_structural_token_t) * *capacity);
+    if (*tokens == NULL) {
+      *capacity = 0;
+      return JSON_ERR_MEMORY;
+    }
+  }
+  json_structural_t *state = json_malloc(sizeof(json_structural_t));
+  if (state == NULL) return JSON_ERR_MEMORY;
+  state->json = json;
+  state->length = length;
+  state->tokens = *tokens;
+  state->capacity = *capacity;
+  state->count = 0;
+  state->depth = 0;
+  state->expect = JSON_EXPECT_VALUE;
+  state->string_open = -1;
+  state->string_is_key = false;
+  state->fallback = false;
+  state->memory = false;
+  state->elements = elements;
+  if (elements) {
+    // the elements are children of a root array that is never closed
+    json_structural_token(state, JSMN_ARRAY, 0, length);
+    state->stack[0].container = 0;
+    state->stack[0].key = -1;
+    state->depth = 1;
+  }
+
+  json_classify_fn classify = json_classifier();
+  uint64_t in_string = 0;                                    // all ones when the previous block ended inside a string
+  uint64_t escaped_carry = 0;                                // first character of the block is escaped
+  uint64_t scalar_carry = 0;                                 // last character of the previous block was part of a primitive
+  char tail[64];
+  for (size_t offset = 0; offset < length && !state->fallback && !state->memory; offset += 64) {
+    const char *block = json + offset;
+    size_t block_length = length - offset < 64 ? length - offset : 64;
+    if (block_length < 64) {
+      // pad the final block with whitespace
+      memset(tail, ' ', sizeof(tail));
+      memcpy(tail, block, block_length);
+      block = tail;
+    }
+    json_block_masks_t masks;
+    classify(block, &masks);
+
+    // escaped characters follow a backslash that is not itself escaped
+    uint64_t escaped = escaped_carry;
+    escaped_carry = 0;
+    for (uint64_t backslash = masks.backslash; backslash; backslash &= backslash - 1) {
+      int i = json_ctz64(backslash);
+      if ((escaped >> i) & 1) continue;
+      if (!json_structural_escape_valid(json, length, offset + i)) state->fallback = true;
+      if (i == 63) escaped_carry = 1;
+      else escaped |= (uint64_t)1 << (i + 1);
+    }
+    uint64_t quotes = masks.quote & ~escaped;
+    uint64_t string = json_prefix_xor(quotes) ^ in_string;
+    in_string = (uint64_t)((int64_t)string >> 63);
+    uint64_t scalar = ~(masks.op | masks.space | quotes | string);
+    uint64_t starts = scalar & ~((scalar << 1) | scalar_carry);
+    scalar_carry = scalar >> 63;
+    uint64_t structurals = (masks.op & ~string) | quotes | starts;
+    if (block_length < 64) structurals &= ((uint64_t)1 << block_length) - 1;
+
+    for (; structurals && !state->fallback && !state->memory; structurals &= structurals - 1) {
+      json_structural_step(state, offset + json_ctz64(structurals));
+    }
+  }
+
+  int token_count = state->count;
+  bool complete = state->string_open < 0 &&
+    (elements ? state->depth == 1 && state->expect == JSON_EXPECT_NEXT : state->expect == JSON_EXPECT_NOTHING);
+  bool fallback = state->fallback || !complete;
+  bool memory = state->memory;
+  *tokens = state->tokens;
+  *capacity = state->capacity;
+  json_free(state);
+  JSON_STATS_STOP(parse_cycles, start);
+  if (memory) return JSON_ERR_MEMORY;
+  if (fallback) {
+    // jsmn has no root array to parse elements into
+    if (elements) return JSON_ERR_INVALID;
+#if defined(JSON_WIDE_TOKENS)
+    // jsmn tokens are narrower than the buffer, the caller parses with jsmn
+    return 0;
+#else
+    // let jsmn decide how to tokenize or reject the input
+    jsmn_init(parser);
+    return json_parse_tokens_grow(parser, json, length, tokens, capacity);
+#endif
+  }
+  parser->pos = length;
+  parser->toknext = token_count;
+  parser->toksuper = -1;
+  JSON_STATS_ADD(parses, 1);
+  return token_count;
+}
+
+
+#if defined(JSON_WIDE_TOKENS)
+// parse into wide tokens and copy them to a jsmn token buffer, which limits the input to jsmn offsets
+static int json_structural_narrow (jsmn_parser *parser, const char *json, size_t length, jsmntok_t **tokens, unsigned int *capacity, bool elements) {
+  if (!parser || !json || !tokens || !capacity) return JSON_ERR_INVALID;
+  if (length > JSON_TOKEN_OFFSET_MAX) return JSON_ERR_RANGE;
+  json_structural_token_t *wide = NULL;
+  unsigned int wide_capacity = *capacity;
+  int token_count = json_structural_parse(parser, json, length, &wide, &wide_capacity, elements);
+  if (token_count == 0) {
+    json_free(wide);
+    jsmn_init(parser);
+    return json_parse_tokens_grow(parser, json, length, tokens, capacity);
+  }
+  if (token_count > 0 && (*tokens == NULL || *capacity < (unsigned int)token_count)) {
+    jsmntok_t *grown = json_realloc(*tokens, sizeof(jsmntok_t) * token_count);
+    if (grown == NULL) token_count = JSON_ERR_MEMORY;
+    else {
+      *tokens = grown;
+      *capacity = token_count;
+    }
+  }
+  for (int i = 0; i < token_count; i++) {
+    jsmntok_t *tok = &(*tokens)[i];
+    tok->type = wide[i].type;
+    tok->start = (int)wide[i].start;
+    tok->end = (int)wide[i].end;
+    tok->size = wide[i].size;
+  }
+  json_free(wide);
+  return token_count;
+}
+
+
+// pack wide tokens in place into json_token_t, the packed tokens are smaller so each one
+// is written below the wide tokens that are still to be read
+static int json_structural_pack (json_structural_token_t *wide, int token_count, json_token_t **tokens) {
+  json_token_t *packed = (json_token_t *)wide;
+  for (int i = 0; i < token_count; i++) {
+    json_structural_token_t tok = wide[i];
+    if (tok.size < 0 || (unsigned long)tok.size > JSON_TOKEN_SIZE_MAX) {
+      json_free(wide);
+      return JSON_ERR_RANGE;
+    }
+    packed[i].start = (json_token_word_t)tok.start;
+    packed[i].start_high = (uint16_t)(tok.start >> 32);
+    json_tok_set_end(&packed[i], tok.end);
+    json_token_word_t code = tok.type == JSMN_OBJECT ? 0 : tok.type == JSMN_ARRAY ? 1 : tok.type == JSMN_STRING ? 2 : 3;
+    packed[i].size_type = (json_token_word_t)(tok.size | (code << JSON_TOKEN_TYPE_SHIFT));
+  }
+  // return the memory freed by packing
+  json_token_t *shrunk = json_realloc(packed, sizeof(json_token_t) * token_count);
+  *tokens = shrunk != NULL ? shrunk : packed;
+  return token_count;
+}
+#endif
+
+
+/**
+ * Parse the provided JSON string with the structural indexer backend into a token buffer
+ * that is grown as needed, like json_parse_tokens_grow. The tokens are identical to the jsmn
+ * tokens, input that jsmn would tokenize differently than strict JSON is parsed with jsmn.
+ * NOTE: The caller is responsible for freeing the tokens array with json_free, also on failure.
+ *
+ * @param parser The JSON parser object, left in the state jsmn would leave it.
+ * @param json The input JSON string to be parsed.
+ * @param length The length of the JSON string.
+ * @param tokens A pointer to the token buffer, may point to NULL to allocate one sized for the input.
+ * @param capacity A pointer to the number of tokens the buffer can hold, updated when the buffer grows.
+ * @return The number of tokens parsed, or JSONErrorCode on failure.
+ */
+int json_parse_tokens_structural_grow (jsmn_parser *parser, const char *json, size_t length, jsmntok_t **tokens, unsigned int *capacity) {
+#if defined(JSON_WIDE_TOKENS)
+  return json_structural_narrow(parser, json, length, tokens, capacity, false);
+#else
+  return json_structural_parse(parser, json, length, tokens, capacity, false);
+#endif
+}
+
+
+/**
+ * Parse the comma separated elements of a JSON array, the text between its brackets, with the
+ * structural indexer backend. The first token is a root array token spanning the input with
+ * the elements as its children, so a long array can be split between elements and the parts
+ * tokenized independently. Input the structural indexer does not accept as strict JSON fails.
+ * NOTE: The caller is responsible for freeing the tokens array with json_free, also on failure.
+ *
+ * @param parser The JSON parser object.
+ * @param json The array elements to be parsed.
+ * @param length The length of the elements.
+ * @param tokens A pointer to the token buffer, may point to NULL to allocate one sized for the input.
+ * @param capacity A pointer to the number of tokens the buffer can hold, updated when the buffer grows.
+ * @return The number of tokens parsed including the root array token, or JSONErrorCode on failure.
+ */
+int json_parse_elements_structural_grow (jsmn_parser *parser, const char *json, size_t length, jsmntok_t **tokens, unsigned int *capacity) {
+#if defined(JSON_WIDE_TOKENS)
+  return json_structural_narrow(parser, json, length, tokens, capacity, true);
+#else
+  return json_structural_parse(parser, json, length, tokens, capacity, true);
+#endif
+}
+
+
+/**
+ * Parse the provided JSON string with the structural indexer backend and allocate tokens
+ * into the provided tokens pointer. Quotes, escapes and structural characters are located
+ * 64 characters at a time (SSE2 or AVX2 chosen at run time, NEON, or a scalar fallback) and
+ * the tokens are emitted from the structural positions. The tokens are identical to the
+ * tokens from json_parse_tokens, input that jsmn would tokenize differently than strict
+ * JSON is parsed with jsmn.
+ * NOTE: The caller is responsible for freeing the allocated memory for the tokens array with json_free.
+ * NOTE: With JSON_WIDE_TOKENS documents up to JSON_STRUCTURAL_OFFSET_MAX are tokenized, input
+ * that falls back to jsmn is still limited to JSON_TOKEN_OFFSET_MAX.
+ *
+ * @param parser The JSON parser object, left in the state jsmn would leave it.
+ * @param json The input JSON string to be parsed.
+ * @param length The length of the JSON string.
+ * @param tokens A pointer that will be set to the allocated token array.
+ * @return The number of tokens allocated into the tokens pointer, JSON_ERR_RANGE if length is over JSON_STRUCTURAL_OFFSET_MAX, or JSONErrorCode on failure.
+ */
+int json_parse_tokens_structural (jsmn_parser *parser, const char *json, size_t length, json_token_t **tokens) {
+  if (!parser || !json || !tokens) return JSON_ERR_INVALID;
+  *tokens = NULL;
+  json_structural_token_t *parsed = NULL;
+  unsigned int capacity = 0;
+  int token_count = json_structural_parse(parser, json, length, &parsed, &capacity, false);
+#if defined(JSON_WIDE_TOKENS)
+  if (token_count > 0) return json_structural_pack(parsed, token_count, tokens);
+  json_free(parsed);
+  // let jsmn decide how to tokenize or reject the input
+  return token_count < 0 ? token_count : json_parse_tokens_n(parser, json, length, tokens);
+#else
+  if (token_count <= 0) {
+    json_free(parsed);
+    return token_count < 0 ? token_count : JSON_ERR_INVALID;
+  }
+  int err = json_tokens_compact(parsed, token_count, tokens);
+  if (err != JSON_ERR_NONE) {
+    json_free(parsed);
+    *tokens = NULL;
+    return err;
+  }
+#if defined(JSON_COMPACT_TOKENS)
+  // return the memory freed by compacting
+  json_token_t *shrunk = json_realloc(*tokens, sizeof(json_token_t) * token_count);
+  if (shrunk != NULL) *tokens = shrunk;
+#endif
+  return token_count;
+#endif
+}
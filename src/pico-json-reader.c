@@ -2,8 +2,202 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <float.h>
+#include <limits.h>
+#include <locale.h>
+#include <math.h>
+#if !defined(LIB_PICO_STDLIB)
+#include <time.h>
+#endif
 #include "jsmn.h"
 #include "pico-json-reader.h"
+#include "pico-json-reader-stats.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+
+static void * json_default_alloc (void *context, size_t size) {
+  (void)context;
+  return malloc(size);
+}
+
+static void * json_default_realloc (void *context, void *ptr, size_t size) {
+  (void)context;
+  return realloc(ptr, size);
+}
+
+static void json_default_free (void *context, void *ptr) {
+  (void)context;
+  free(ptr);
+}
+
+static const json_allocator_t json_default_allocator = {
+  .context = NULL,
+  .alloc = json_default_alloc,
+  .realloc = json_default_realloc,
+  .free = json_default_free
+};
+
+// the allocator used for all memory allocated by the reader
+static JSON_THREAD_LOCAL const json_allocator_t *json_active_allocator = &json_default_allocator;
+
+// the token table used by the traversal helpers when its token array is searched
+static JSON_THREAD_LOCAL json_token_table_t *json_active_table = NULL;
+
+
+/**
+ * Set the allocator used for all memory allocated by the reader, i.e. token arrays,
+ * string values and index arrays. Pass NULL to restore the default malloc allocator.
+ * NOTE: Memory must be freed with the allocator that allocated it.
+ * NOTE: With JSON_ENABLE_THREADS the allocator is set for the calling thread only.
+ *
+ * @param allocator The allocator to use, the allocator must remain valid while it is set.
+ */
+void json_set_allocator (const json_allocator_t *allocator) {
+  json_active_allocator = allocator ? allocator : &json_default_allocator;
+}
+
+
+/**
+ * Get the allocator currently used by the reader.
+ *
+ * @return The active allocator.
+ */
+const json_allocator_t * json_get_allocator (void) {
+  return json_active_allocator;
+}
+
+
+/**
+ * Allocate memory with the active allocator.
+ *
+ * @param size The number of bytes to allocate.
+ * @return A pointer to the allocated memory or NULL on failure.
+ */
+void * json_malloc (size_t size) {
+  JSON_STATS_ADD(allocations, 1);
+  JSON_STATS_ADD(allocated_bytes, size);
+  void *ptr = json_active_allocator->alloc(json_active_allocator->context, size);
+  // memory at the address of an attached token array means the array was released
+  json_token_table_release(ptr);
+  return ptr;
+}
+
+
+/**
+ * Resize memory allocated with the active allocator.
+ *
+ * @param ptr The memory to resize, or NULL to allocate new memory.
+ * @param size The new size in bytes.
+ * @return A pointer to the resized memory or NULL on failure, the original memory is unchanged on failure.
+ */
+void * json_realloc (void *ptr, size_t size) {
+  JSON_STATS_ADD(allocations, 1);
+  JSON_STATS_ADD(allocated_bytes, size);
+  json_token_table_release(ptr);
+  void *resized = json_active_allocator->realloc(json_active_allocator->context, ptr, size);
+  json_token_table_release(resized);
+  return resized;
+}
+
+
+/**
+ * Free memory allocated by the reader, i.e. tokens from json_parse_tokens or strings from json_get_value_s.
+ * Freeing the token array of the attached token table detaches the table.
+ *
+ * @param ptr The memory to free, may be NULL.
+ */
+void json_free (void *ptr) {
+  json_token_table_release(ptr);
+  if (ptr) json_active_allocator->free(json_active_allocator->context, ptr);
+}
+
+
+// each arena allocation is preceded by a header holding its size so realloc can copy
+#define JSON_ARENA_ALIGN (sizeof(max_align_t))
+#define JSON_ARENA_HEADER (((sizeof(size_t) + JSON_ARENA_ALIGN - 1) / JSON_ARENA_ALIGN) * JSON_ARENA_ALIGN)
+
+static size_t json_arena_align (size_t size) {
+  return (size + JSON_ARENA_ALIGN - 1) & ~(JSON_ARENA_ALIGN - 1);
+}
+
+static void * json_arena_alloc (void *context, size_t size) {
+  json_arena_t *arena = context;
+  size_t start = json_arena_align(arena->used);
+  size_t needed = JSON_ARENA_HEADER + json_arena_align(size);
+  if (start > arena->capacity || arena->capacity - start < needed) return NULL;
+  unsigned char *block = arena->buffer + start;
+  *(size_t *)block = size;
+  arena->last = start;
+  arena->used = start + needed;
+  return block + JSON_ARENA_HEADER;
+}
+
+static void * json_arena_realloc (void *context, void *ptr, size_t size) {
+  json_arena_t *arena = context;
+  if (ptr == NULL) return json_arena_alloc(context, size);
+  unsigned char *block = (unsigned char *)ptr - JSON_ARENA_HEADER;
+  size_t old_size = *(size_t *)block;
+  // the last allocation can grow or shrink in place
+  if (block == arena->buffer + arena->last) {
+    size_t needed = JSON_ARENA_HEADER + json_arena_align(size);
+    if (arena->capacity - arena->last < needed) return NULL;
+    *(size_t *)block = size;
+    arena->used = arena->last + needed;
+    return ptr;
+  }
+  void *moved = json_arena_alloc(context, size);
+  if (moved == NULL) return NULL;
+  memcpy(moved, ptr, old_size < size ? old_size : size);
+  return moved;
+}
+
+static void json_arena_free (void *context, void *ptr) {
+  json_arena_t *arena = context;
+  // only the last allocation is reclaimed, everything else is reclaimed by json_arena_reset
+  unsigned char *block = (unsigned char *)ptr - JSON_ARENA_HEADER;
+  if (block == arena->buffer + arena->last) {
+    arena->used = arena->last;
+  }
+}
+
+
+/**
+ * Initialize a bump pointer arena over a caller supplied buffer and the allocator that uses it.
+ * Pass the allocator to json_set_allocator and call json_arena_reset once per message to
+ * reclaim everything a parse and its lookups allocated.
+ *
+ * @param arena The arena to initialize.
+ * @param allocator The allocator to initialize for the arena.
+ * @param buffer The memory the arena allocates from.
+ * @param capacity The size of the buffer in bytes.
+ */
+void json_arena_init (json_arena_t *arena, json_allocator_t *allocator, void *buffer, size_t capacity) {
+  arena->buffer = buffer;
+  arena->capacity = capacity;
+  arena->used = 0;
+  arena->last = 0;
+  allocator->context = arena;
+  allocator->alloc = json_arena_alloc;
+  allocator->realloc = json_arena_realloc;
+  allocator->free = json_arena_free;
+}
+
+
+/**
+ * Reclaim all memory allocated from the arena in constant time.
+ *
+ * @param arena The arena to reset.
+ */
+void json_arena_reset (json_arena_t *arena) {
+  arena->used = 0;
+  arena->last = 0;
+}
 
 
 /**
@@ -31,35 +225,379 @@ int json_token_count (jsmn_parser *parser, char *json) {
 }
 
 
+/**
+ * Estimate an upper bound for the number of tokens in a JSON string without parsing it.
+ * Every token other than the root is preceded by one of the structural characters
+ * '{', '[', ',' or ':', so counting those characters gives a cheap bound that is
+ * exact enough to size a token array for a single parse pass.
+ *
+ * @param json The input JSON string.
+ * @param length The number of characters of the JSON string to scan.
+ * @return The estimated maximum token count, or JSONErrorCode if the input is NULL.
+ */
+int json_estimate_token_count (const char *json, size_t length) {
+  if (!json) return JSON_ERR_INVALID;
+  int estimate = 1; // the root token
+  for (size_t i = 0; i < length && json[i] != '\0'; i++) {
+    switch (json[i]) {
+      case '{':
+      case '[':
+      case ',':
+      case ':':
+        estimate += 1;
+        break;
+      default:
+        break;
+    }
+  }
+  return estimate;
+}
+
+
+/**
+ * Parse the provided JSON string into a caller supplied token buffer.
+ * The parser must be initialized with jsmn_init before the first call. If the buffer is too
+ * small then JSMN_ERROR_NOMEM is returned and the parser state is preserved, the caller may
+ * then provide a larger buffer holding the tokens parsed so far (i.e. realloc) and call again
+ * to continue parsing where the previous call stopped.
+ * Every other failure is a JSONErrorCode. JSMN_ERROR_NOMEM has the value of JSON_ERR_INVALID,
+ * the buffer is full when parser->toknext equals capacity, invalid JSON stops before that or
+ * fails again with toknext below the larger capacity when it is resumed.
+ *
+ * @param parser The initialized JSON parser object.
+ * @param json The input JSON string to be parsed.
+ * @param length The length of the JSON string.
+ * @param tokens The token buffer to fill.
+ * @param capacity The number of tokens the buffer can hold.
+ * @return The total number of tokens parsed, JSMN_ERROR_NOMEM if more tokens are needed, JSON_ERR_RANGE if the string is longer than JSON_TOKEN_OFFSET_MAX, or JSONErrorCode on failure.
+ */
+int json_parse_tokens_into (jsmn_parser *parser, const char *json, size_t length, jsmntok_t *tokens, unsigned int capacity) {
+  if (!parser || !json || !tokens) return JSON_ERR_INVALID;
+  if (length > JSON_TOKEN_OFFSET_MAX) return JSON_ERR_RANGE;
+  json_token_table_release(tokens);
+  JSON_STATS_START(start);
+  int token_count = jsmn_parse(parser, json, length, tokens, capacity);
+  JSON_STATS_STOP(parse_cycles, start);
+  JSON_STATS_ADD(parses, 1);
+  if (token_count == JSMN_ERROR_NOMEM) return JSMN_ERROR_NOMEM;
+  return token_count < 0 ? JSON_ERR_INVALID : token_count;
+}
+
+
+/**
+ * Parse the provided JSON string into a token buffer that is grown geometrically as needed.
+ * The parser must be initialized with jsmn_init before the first call. When the buffer fills
+ * it is doubled with json_realloc and parsing continues from where jsmn stopped, so the input is
+ * only scanned once.
+ * NOTE: The caller is responsible for freeing the tokens array with json_free, also on failure.
+ *
+ * @param parser The initialized JSON parser object.
+ * @param json The input JSON string to be parsed.
+ * @param length The length of the JSON string.
+ * @param tokens A pointer to the token buffer, may point to NULL if capacity is 0.
+ * @param capacity A pointer to the number of tokens the buffer can hold, updated when the buffer grows.
+ * @return The number of tokens parsed, or JSONErrorCode on failure.
+ */
+int json_parse_tokens_grow (jsmn_parser *parser, const char *json, size_t length, jsmntok_t **tokens, unsigned int *capacity) {
+  if (!json || !tokens || !capacity) return JSON_ERR_INVALID;
+  if (length > JSON_TOKEN_OFFSET_MAX) return JSON_ERR_RANGE;
+  json_token_table_release(*tokens);
+  JSON_STATS_START(start);
+  while (true) {
+    if (*tokens == NULL || *capacity == 0) {
+      *capacity = *capacity ? *capacity : JSON_MIN_TOKEN_CAPACITY;
+      *tokens = json_malloc(sizeof(jsmntok_t) * *capacity);
+      if (*tokens == NULL) {
+        *capacity = 0;
+        return JSON_ERR_MEMORY;
+      }
+    }
+    int token_count = jsmn_parse(parser, json, length, *tokens, *capacity);
+    if (token_count != JSMN_ERROR_NOMEM) {
+      JSON_STATS_STOP(parse_cycles, start);
+      JSON_STATS_ADD(parses, 1);
+      return token_count < 0 ? JSON_ERR_INVALID : token_count;
+    }
+    // grow the buffer and resume parsing from the current parser position, the token count is an int
+    if (*capacity > INT_MAX / 2 || SIZE_MAX / *capacity / 2 < sizeof(jsmntok_t)) return JSON_ERR_MEMORY;
+    unsigned int grown = *capacity * 2;
+    jsmntok_t *tmp = json_realloc(*tokens, sizeof(jsmntok_t) * grown);
+    if (tmp == NULL) return JSON_ERR_MEMORY;
+    *tokens = tmp;
+    *capacity = grown;
+  }
+}
+
+
+/**
+ * Convert tokens parsed by jsmn to json_token_t in place. With JSON_COMPACT_TOKENS or
+ * JSON_WIDE_TOKENS each token is packed into the start of the same memory, otherwise the
+ * tokens are already json_token_t.
+ * Every token is checked before any is converted so the jsmn tokens are unchanged on failure.
+ *
+ * @param tokens The tokens parsed by jsmn.
+ * @param token_count The number of parsed tokens.
+ * @param compact Set to the converted tokens, in the same memory as tokens.
+ * @return JSON_ERR_NONE on success, JSON_ERR_RANGE if an offset or child count does not fit a compact token.
+ */
+int json_tokens_compact (jsmntok_t *tokens, int token_count, json_token_t **compact) {
+  if (!tokens || !compact || token_count < 0) return JSON_ERR_INVALID;
+#if defined(JSON_PACKED_TOKENS)
+  for (int i = 0; i < token_count; i++) {
+    jsmntok_t *tok = &tokens[i];
+    if (tok->start < 0 || tok->end < tok->start || (unsigned long)tok->end > JSON_TOKEN_OFFSET_MAX) return JSON_ERR_RANGE;
+    if (tok->size < 0 || (unsigned long)tok->size > JSON_TOKEN_SIZE_MAX) return JSON_ERR_RANGE;
+    if (tok->type != JSMN_OBJECT && tok->type != JSMN_ARRAY && tok->type != JSMN_STRING && tok->type != JSMN_PRIMITIVE) return JSON_ERR_INVALID;
+  }
+  // a packed token never overlaps a jsmn token that is still to be read
+  json_token_t *packed = (json_token_t *)tokens;
+  for (int i = 0; i < token_count; i++) {
+    jsmntok_t tok = tokens[i];
+    json_token_word_t code = tok.type == JSMN_OBJECT ? 0 : tok.type == JSMN_ARRAY ? 1 : tok.type == JSMN_STRING ? 2 : 3;
+    packed[i].start = tok.start;
+    packed[i].end = tok.end;
+#if defined(JSON_WIDE_TOKENS)
+    packed[i].start_high = 0;
+    packed[i].end_high = 0;
+#endif
+    packed[i].size_type = (json_token_word_t)(tok.size | (code << JSON_TOKEN_TYPE_SHIFT));
+  }
+  *compact = packed;
+#else
+  *compact = tokens;
+#endif
+  return JSON_ERR_NONE;
+}
+
+
+// compact tokens allocated by the reader and return the unused memory, the tokens are freed on failure
+static int json_tokens_keep (jsmntok_t *parsed, int token_count, json_token_t **tokens) {
+  int err = json_tokens_compact(parsed, token_count, tokens);
+  if (err != JSON_ERR_NONE) {
+    json_free(parsed);
+    *tokens = NULL;
+    return err;
+  }
+#if defined(JSON_COMPACT_TOKENS)
+  json_token_t *shrunk = json_realloc(*tokens, sizeof(json_token_t) * token_count);
+  if (shrunk != NULL) *tokens = shrunk;
+#endif
+  return token_count;
+}
+
+
 /**
  * Parse the provided JSON string and allocate tokens into the provided tokens pointer.
- * NOTE: The caller is responsible for freeing the allocated memory for the tokens array.
+ * The string is measured with json_length so at most MAX_JSON_INPUT_LENGTH characters are
+ * parsed, use json_parse_tokens_n to parse a string of known length.
+ * NOTE: The caller is responsible for freeing the allocated memory for the tokens array with json_free.
+ * NOTE: With JSON_COMPACT_TOKENS the tokens are compacted after parsing and JSON_ERR_RANGE is returned if they do not fit.
  *
  * @param parser The initialized JSON parser object.
  * @param json The input JSON string to be parsed.
- * @param tokens A pointer to a pointer to an array of jsmntok_t structs, where each element represents a token in the JSON object. If NULL is passed, this function will allocate memory for the tokens array and store it in the provided pointer.
+ * @param tokens A pointer to a pointer to an array of json_token_t structs, where each element represents a token in the JSON object. If NULL is passed, this function will allocate memory for the tokens array and store it in the provided pointer.
  *
  * @return The number of tokens allocated into the tokens pointer, or JSONErrorCode on failure.
  */
-int json_parse_tokens (jsmn_parser *parser, char *json, jsmntok_t **tokens) {
-  int token_count = json_token_count(parser, json);
-  if (token_count <= 0) return JSON_ERR_INVALID;
+int json_parse_tokens (jsmn_parser *parser, char *json, json_token_t **tokens) {
+  int length = json_length(json);
+  if (length <= 0) return JSON_ERR_INVALID;
+  return json_parse_tokens_n(parser, json, length, tokens);
+}
+
+
+/**
+ * Parse the first length characters of a JSON string and allocate tokens into the provided
+ * tokens pointer. The string does not need to be NUL terminated and nothing past length is
+ * read, so a document can be parsed out of a larger buffer or a read only file mapping.
+ * The token array is sized from json_estimate_token_count so the common case needs one
+ * allocation and a single jsmn pass over the input.
+ * NOTE: The caller is responsible for freeing the allocated memory for the tokens array with json_free.
+ *
+ * @param parser The JSON parser object.
+ * @param json The input JSON string to be parsed.
+ * @param length The length of the JSON string.
+ * @param tokens A pointer that will be set to the allocated token array.
+ * @return The number of tokens allocated into the tokens pointer, JSON_ERR_RANGE if length is over JSON_TOKEN_OFFSET_MAX, or JSONErrorCode on failure.
+ */
+int json_parse_tokens_n (jsmn_parser *parser, const char *json, size_t length, json_token_t **tokens) {
+  if (!parser || !json || !tokens) return JSON_ERR_INVALID;
+  *tokens = NULL;
+  if (length == 0) return JSON_ERR_INVALID;
+  if (length > JSON_TOKEN_OFFSET_MAX) return JSON_ERR_RANGE;
 
-  // allocate memory for tokens
-  *tokens = malloc(sizeof(jsmntok_t) * token_count);
-  if (*tokens == NULL) return JSON_ERR_MEMORY;
+  // allocate memory for the estimated number of tokens
+  unsigned int capacity = json_estimate_token_count(json, length);
+  jsmntok_t *parsed = NULL;
 
   // parse tokens
   jsmn_init(parser);
-  token_count = jsmn_parse(parser, json, strlen(json), *tokens, token_count);
-  return token_count;
+  int token_count = json_parse_tokens_grow(parser, json, length, &parsed, &capacity);
+  if (token_count <= 0) {
+    json_free(parsed);
+    return token_count < 0 ? token_count : JSON_ERR_INVALID;
+  }
+  return json_tokens_keep(parsed, token_count, tokens);
+}
+
+
+/**
+ * Initialize a stream for parsing a JSON document that arrives in chunks.
+ *
+ * @param stream The stream to initialize.
+ * @return JSON_ERR_NONE on success, JSONErrorCode on failure.
+ */
+int json_stream_init (json_stream_t *stream) {
+  if (!stream) return JSON_ERR_INVALID;
+  memset(stream, 0, sizeof(*stream));
+  jsmn_init(&stream->parser);
+  return JSON_ERR_NONE;
+}
+
+
+// check if the root value has been completely tokenized
+static bool json_stream_root_complete (json_stream_t *stream) {
+  if (stream->parser.toknext == 0) return false;
+  jsmntok_t *root = (jsmntok_t *)stream->tokens;
+  if (root->type == JSMN_OBJECT || root->type == JSMN_ARRAY) return root->end != -1;
+  return root->type == JSMN_STRING || (size_t)root->end < stream->length || stream->ended;
+}
+
+
+// tokenize the buffered input from the current parser position
+static int json_stream_parse (json_stream_t *stream) {
+  int token_count;
+  // stream->tokens holds jsmn tokens until the document is complete
+  jsmntok_t *tokens = (jsmntok_t *)stream->tokens;
+  JSON_STATS_START(start);
+  while (true) {
+    if (stream->token_capacity <= stream->parser.toknext) {
+      unsigned int grown = stream->token_capacity ? stream->token_capacity * 2 : JSON_MIN_TOKEN_CAPACITY;
+      jsmntok_t *tmp = json_realloc(tokens, sizeof(jsmntok_t) * grown);
+      if (tmp == NULL) return JSON_ERR_MEMORY;
+      tokens = tmp;
+      stream->tokens = (json_token_t *)tmp;
+      stream->token_capacity = grown;
+    }
+    token_count = jsmn_parse(&stream->parser, stream->buffer, stream->length, tokens, stream->token_capacity);
+    if (token_count != JSMN_ERROR_NOMEM) break;
+    // force the buffer to grow and resume
+    stream->token_capacity = stream->parser.toknext;
+  }
+  JSON_STATS_STOP(parse_cycles, start);
+  if (token_count == JSMN_ERROR_INVAL) return JSON_ERR_INVALID;
+  // a primitive that ends at the end of the input may continue in the next chunk
+  unsigned int last = stream->parser.toknext - 1;
+  if (!stream->ended && stream->parser.toknext > 0 && tokens[last].type == JSMN_PRIMITIVE &&
+      (size_t)tokens[last].end == stream->length) {
+    if (stream->parser.toksuper != -1) tokens[stream->parser.toksuper].size -= 1;
+    stream->parser.pos = tokens[last].start;
+    stream->parser.toknext = last;
+  }
+  if (!json_stream_root_complete(stream)) return JSON_STREAM_NEED_MORE;
+  // tokens beyond the root value belong to the next document
+  int root_end = tokens[0].end;
+  int count = 1;
+  while ((unsigned int)count < stream->parser.toknext && tokens[count].start < root_end) count++;
+  int err = json_tokens_compact(tokens, count, &stream->tokens);
+  if (err != JSON_ERR_NONE) return err;
+  stream->token_count = count;
+  JSON_STATS_ADD(parses, 1);
+  return JSON_STREAM_COMPLETE;
+}
+
+
+/**
+ * Feed the next chunk of a JSON document to a stream. The chunk is appended to the stream
+ * buffer and tokenized from where the previous chunk stopped, strings and numbers that are
+ * split across chunks are completed by later chunks. Once JSON_STREAM_COMPLETE is returned
+ * the document is available in stream->buffer with stream->token_count tokens in
+ * stream->tokens for use with the json_get methods.
+ *
+ * @param stream The initialized stream.
+ * @param chunk The next characters of the document.
+ * @param length The number of characters in the chunk.
+ * @return JSON_STREAM_COMPLETE when the top level value is complete, JSON_STREAM_NEED_MORE if more input is needed, JSONErrorCode on failure.
+ */
+int json_feed (json_stream_t *stream, const char *chunk, size_t length) {
+  if (!stream || (!chunk && length)) return JSON_ERR_INVALID;
+  if (stream->token_count > 0) return JSON_STREAM_COMPLETE;
+  if (length > JSON_TOKEN_OFFSET_MAX - stream->length) return JSON_ERR_RANGE;
+  // grow the buffer geometrically, keeping room for the NUL terminator
+  if (stream->length + length + 1 > stream->capacity) {
+    size_t grown = stream->capacity ? stream->capacity : JSON_STREAM_MIN_CAPACITY;
+    while (grown < stream->length + length + 1) grown *= 2;
+    char *tmp = json_realloc(stream->buffer, grown);
+    if (tmp == NULL) return JSON_ERR_MEMORY;
+    stream->buffer = tmp;
+    stream->capacity = grown;
+  }
+  memcpy(stream->buffer + stream->length, chunk, length);
+  JSON_STATS_ADD(copied_bytes, length);
+  stream->length += length;
+  stream->buffer[stream->length] = '\0';
+  return json_stream_parse(stream);
+}
+
+
+/**
+ * Signal the end of the input so a trailing top level primitive is completed.
+ *
+ * @param stream The stream.
+ * @return JSON_STREAM_COMPLETE when the top level value is complete, JSON_ERR_INVALID if the input ended inside a value.
+ */
+int json_feed_end (json_stream_t *stream) {
+  if (!stream) return JSON_ERR_INVALID;
+  if (stream->token_count > 0) return JSON_STREAM_COMPLETE;
+  stream->ended = true;
+  if (stream->buffer == NULL) return JSON_ERR_INVALID;
+  int result = json_stream_parse(stream);
+  return result == JSON_STREAM_NEED_MORE ? JSON_ERR_INVALID : result;
+}
+
+
+/**
+ * Prepare a stream for the next document, keeping its buffers. Input that followed the
+ * completed document is kept as the start of the next document.
+ *
+ * @param stream The stream.
+ * @return JSON_STREAM_COMPLETE if the kept input already holds a complete document, JSON_STREAM_NEED_MORE or JSONErrorCode otherwise.
+ */
+int json_stream_reset (json_stream_t *stream) {
+  size_t keep = 0;
+  if (stream->token_count > 0) {
+    size_t root_end = json_tok_end(&stream->tokens[0]);
+    // a string token ends before its closing quote
+    if (json_tok_type(&stream->tokens[0]) == JSMN_STRING) root_end += 1;
+    keep = stream->length - root_end;
+    memmove(stream->buffer, stream->buffer + root_end, keep);
+  }
+  stream->length = keep;
+  stream->token_count = 0;
+  stream->ended = false;
+  jsmn_init(&stream->parser);
+  if (stream->buffer == NULL) return JSON_STREAM_NEED_MORE;
+  stream->buffer[keep] = '\0';
+  return keep ? json_stream_parse(stream) : JSON_STREAM_NEED_MORE;
+}
+
+
+/**
+ * Free the buffers of a stream.
+ *
+ * @param stream The stream.
+ */
+void json_stream_free (json_stream_t *stream) {
+  json_free(stream->buffer);
+  json_free(stream->tokens);
+  json_stream_init(stream);
 }
 
 
 /**
  * Get the string value for the given key from the provided JSON string.
  * Returns the JSON_ERR_NONE on success or JSONErrorCode on failure.
- * NOTE: The caller is responsible for freeing the allocated memory.
+ * NOTE: The caller is responsible for freeing the allocated memory with json_free.
  *
  * @param key The key for which the value should be retrieved.
  * @param value A pointer to a char pointer that will be set to the value.
@@ -69,19 +607,19 @@ int json_parse_tokens (jsmn_parser *parser, char *json, jsmntok_t **tokens) {
  *
  * @return int JSON_ERR_NONE on success, JSONErrorCode on failure.
 */
-int json_get_value_s (char *key, char **value, const char *json, jsmntok_t *tokens, int start_token) {
-  int key_index = json_key_index(tokens, start_token, key, (char*)json);
-  if (key_index < 0 || tokens[key_index].size != 1) {
+int json_get_value_s (char *key, char **value, const char *json, json_token_t *tokens, int start_token) {
+  int value_index = json_value_index(tokens, start_token, key, (char*)json);
+  if (value_index < 0) {
     return JSON_ERR_KEY_INVALID;
   }
-  return json_get_index_s(key_index + 1, value, json, tokens);
+  return json_get_index_s(value_index, value, json, tokens);
 }
 
 
 /**
  * Get the string value from the JSON string using the given token index.
  * Returns JSON_ERR_NONE on success, JSONErrorCode on failure.
- * NOTE: The caller is responsible for freeing the allocated memory.
+ * NOTE: The caller is responsible for freeing the allocated memory with json_free.
  *
  * @param index The token index of the string value.
  * @param value A pointer to a char pointer that will be set to the allocated string value.
@@ -90,403 +628,2762 @@ int json_get_value_s (char *key, char **value, const char *json, jsmntok_t *toke
  *
  * @return int JSON_ERR_NONE on success, JSONErrorCode on failure.
  */
-int json_get_index_s (int index, char **value, const char *json, jsmntok_t *tokens) {
-  *value = calloc(tokens[index].end - tokens[index].start + 1, sizeof(char));
+int json_get_index_s (int index, char **value, const char *json, json_token_t *tokens) {
+  int length = json_tok_end(&tokens[index]) - json_tok_start(&tokens[index]);
+  *value = json_malloc(length + 1);
   if (!*value) return JSON_ERR_MEMORY; // failed to allocate memory
-  memcpy(*value, json + tokens[index].start, tokens[index].end - tokens[index].start);
+  memcpy(*value, json + json_tok_start(&tokens[index]), length);
+  JSON_STATS_ADD(copied_bytes, length);
+  (*value)[length] = '\0';
   return JSON_ERR_NONE;
 }
 
 
 /**
- * Retrieve an integer value from a JSON object at the given key.
+ * Get a view of the string value for the given key without copying it.
+ * The view points into the JSON string and is not NUL terminated.
  *
- * @param key The key to search for in the JSON object.
- * @param value A pointer to an integer to store the retrieved value.
- * @param json The JSON string to search.
+ * @param key The key for which the value should be retrieved.
+ * @param value A pointer to the view to set to the value.
+ * @param json The JSON string from which the value should be retrieved.
  * @param tokens The parsed JSON tokens.
- * @param start_token The index of the token to start searching from.
- * @return JSON_ERR_NONE on success, JSONErrorCode on failure.
- */
-int json_get_value_i (char *key, int *value, const char *json, jsmntok_t *tokens, int start_token) {
-  int key_index = json_key_index(tokens, start_token, key, (char*)json);
-  if (key_index < 0 || tokens[key_index].size != 1) {
+ * @param start_token The index of the token from which the search should start.
+ *
+ * @return int JSON_ERR_NONE on success, JSONErrorCode on failure.
+*/
+int json_get_value_sv (char *key, json_string_view_t *value, const char *json, json_token_t *tokens, int start_token) {
+  int value_index = json_value_index(tokens, start_token, key, (char*)json);
+  if (value_index < 0) {
     return JSON_ERR_KEY_INVALID;
   }
-  return json_get_index_i(key_index + 1, value, json, tokens);
+  return json_get_index_sv(value_index, value, json, tokens);
 }
 
 
 /**
- * Get the integer value from the JSON string using the given token index.
- * Returns JSON_ERR_NONE on success, JSONErrorCode on failure.
+ * Get a view of the string value from the JSON string using the given token index.
+ * The view points into the JSON string and is not NUL terminated.
  *
- * @param index The token index of the integer value.
- * @param value A pointer to an integer to store the retrieved value.
+ * @param index The token index of the string value.
+ * @param value A pointer to the view to set to the value.
  * @param json The JSON string from which the string value will be extracted.
  * @param tokens The parsed JSON tokens.
  *
  * @return int JSON_ERR_NONE on success, JSONErrorCode on failure.
  */
-int json_get_index_i (int index, int *value, const char *json, jsmntok_t *tokens) {
-  *value = atoi(json + tokens[index].start);
+int json_get_index_sv (int index, json_string_view_t *value, const char *json, json_token_t *tokens) {
+  value->ptr = json + json_tok_start(&tokens[index]);
+  value->len = json_tok_end(&tokens[index]) - json_tok_start(&tokens[index]);
   return JSON_ERR_NONE;
 }
 
 
 /**
- * Retrieve an double value from a JSON object at the given key.
+ * Copy the string value for the given key into a caller supplied buffer.
  *
- * @param key The key to search for in the JSON object.
- * @param value A pointer to an double to store the retrieved value.
- * @param json The JSON string to search.
+ * @param key The key for which the value should be retrieved.
+ * @param buffer The buffer to copy the NUL terminated value into.
+ * @param capacity The size of the buffer in bytes.
+ * @param length A pointer set to the length of the value, excluding the NUL terminator, may be NULL.
+ * @param json The JSON string from which the value should be retrieved.
  * @param tokens The parsed JSON tokens.
- * @param start_token The index of the token to start searching from.
- * @return JSON_ERR_NONE on success, JSONErrorCode on failure.
- */
-int json_get_value_d (char *key, double *value, const char *json, jsmntok_t *tokens, int start_token) {
-  int key_index = json_key_index(tokens, start_token, key, (char*)json);
-  if (key_index < 0 || tokens[key_index].size != 1) {
+ * @param start_token The index of the token from which the search should start.
+ *
+ * @return int JSON_ERR_NONE on success, JSON_ERR_TRUNCATED if the buffer is too small, JSONErrorCode on failure.
+*/
+int json_get_value_sn (char *key, char *buffer, size_t capacity, size_t *length, const char *json, json_token_t *tokens, int start_token) {
+  int value_index = json_value_index(tokens, start_token, key, (char*)json);
+  if (value_index < 0) {
     return JSON_ERR_KEY_INVALID;
   }
-  return json_get_index_d(key_index + 1, value, json, tokens);
+  return json_get_index_sn(value_index, buffer, capacity, length, json, tokens);
 }
 
 
 /**
- * Get the double value from the JSON string using the given token index.
- * Returns JSON_ERR_NONE on success, JSONErrorCode on failure.
+ * Copy the string value from the JSON string using the given token index into a caller supplied buffer.
+ * On truncation the buffer holds as much of the value as fits, NUL terminated, and length is
+ * set to the full length of the value so the caller can size a larger buffer.
  *
- * @param index The token index of the double value.
- * @param value A pointer to an double to store the retrieved value.
+ * @param index The token index of the string value.
+ * @param buffer The buffer to copy the NUL terminated value into.
+ * @param capacity The size of the buffer in bytes.
+ * @param length A pointer set to the length of the value, excluding the NUL terminator, may be NULL.
  * @param json The JSON string from which the string value will be extracted.
  * @param tokens The parsed JSON tokens.
  *
- * @return int JSON_ERR_NONE on success, JSONErrorCode on failure.
+ * @return int JSON_ERR_NONE on success, JSON_ERR_TRUNCATED if the buffer is too small, JSONErrorCode on failure.
  */
-int json_get_index_d (int index, double *value, const char *json, jsmntok_t *tokens) {
-  *value = atof(json + tokens[index].start);
+int json_get_index_sn (int index, char *buffer, size_t capacity, size_t *length, const char *json, json_token_t *tokens) {
+  size_t value_length = json_tok_end(&tokens[index]) - json_tok_start(&tokens[index]);
+  if (length) *length = value_length;
+  if (!buffer || capacity == 0) return JSON_ERR_TRUNCATED;
+  size_t copy_length = value_length < capacity ? value_length : capacity - 1;
+  memcpy(buffer, json + json_tok_start(&tokens[index]), copy_length);
+  JSON_STATS_ADD(copied_bytes, copy_length);
+  buffer[copy_length] = '\0';
+  return copy_length == value_length ? JSON_ERR_NONE : JSON_ERR_TRUNCATED;
+}
+
+
+// powers of ten that are exactly representable as a double
+static const double json_pow10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+// check if the eight characters loaded into a little endian word are all decimal digits
+static bool json_is_eight_digits (uint64_t chunk) {
+  return ((chunk & 0xF0F0F0F0F0F0F0F0ULL) |
+    (((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) == 0x3333333333333333ULL;
+}
+
+// convert eight decimal digits loaded into a little endian word without branches
+static uint32_t json_eight_digits (uint64_t chunk) {
+  chunk -= 0x3030303030303030ULL;
+  chunk = (chunk * 10) + (chunk >> 8);
+  chunk = (((chunk & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+    (((chunk >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+  return (uint32_t)chunk;
+}
+#endif
+
+
+// accumulate the decimal digits in [*start, end) into value, stopping at the first non digit
+// returns the number of digits consumed, digits beyond a total of 19 are consumed but not accumulated
+static int json_scan_digits (const char **start, const char *end, uint64_t *value, int accumulated) {
+  const char *c = *start;
+  uint64_t v = *value;
+  int digits = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  if (end - c >= 8 && accumulated <= 11) {
+    uint64_t chunk;
+    memcpy(&chunk, c, sizeof(chunk));
+    if (json_is_eight_digits(chunk)) {
+      v = v * 100000000 + json_eight_digits(chunk);
+      c += 8;
+      digits = 8;
+    }
+  }
+#endif
+  for (; c < end && *c >= '0' && *c <= '9'; c++, digits++) {
+    if (accumulated + digits < 19) v = v * 10 + (uint64_t)(*c - '0');
+  }
+  *start = c;
+  *value = v;
+  return digits;
+}
+
+
+// decode an unsigned number with a fraction or exponent that has an integer value, i.e. 1.0 or 1e3
+static int json_parse_integral (const char *start, const char *end, uint64_t *value) {
+  const char *c = start;
+  while (c < end && *c >= '0' && *c <= '9') c++;
+  if (c == start) return JSON_ERR_INVALID;
+  const char *point = c;
+  if (c < end && *c == '.') {
+    c++;
+    while (c < end && *c >= '0' && *c <= '9') c++;
+    if (c == point + 1) return JSON_ERR_INVALID;
+  }
+  const char *digits_end = c;
+  long exponent = 0;
+  if (c < end && (*c == 'e' || *c == 'E')) {
+    c++;
+    bool negative = c < end && *c == '-';
+    if (c < end && (*c == '-' || *c == '+')) c++;
+    const char *exponent_start = c;
+    for (; c < end && *c >= '0' && *c <= '9'; c++) {
+      // larger exponents overflow or leave a fraction either way
+      if (exponent < 100000) exponent = exponent * 10 + (*c - '0');
+    }
+    if (c == exponent_start) return JSON_ERR_INVALID;
+    if (negative) exponent = -exponent;
+  }
+  if (c != end) return JSON_ERR_INVALID;
+  // the exponent moves the point, digits past it must be zero
+  long integer_digits = (long)(point - start) + exponent;
+  long position = 0;
+  uint64_t v = 0;
+  for (c = start; c < digits_end; c++) {
+    if (*c == '.') continue;
+    uint64_t digit = (uint64_t)(*c - '0');
+    if (position++ < integer_digits) {
+      if (v > (UINT64_MAX - digit) / 10) return JSON_ERR_RANGE;
+      v = v * 10 + digit;
+    }
+    else if (digit != 0) return JSON_ERR_INVALID;
+  }
+  // an exponent past the last digit appends zeros
+  for (; v != 0 && position < integer_digits; position++) {
+    if (v > UINT64_MAX / 10) return JSON_ERR_RANGE;
+    v *= 10;
+  }
+  *value = v;
   return JSON_ERR_NONE;
 }
 
 
 /**
- * Retrieve an boolean value from a JSON object at the given key.
+ * Decode an unsigned integer from the characters in [start, end) without reading past end.
+ * A number with a fraction or exponent is accepted when its value is an integer, i.e. 1.0,
+ * 1e3 or -0.0, and rejected as JSON_ERR_INVALID otherwise, i.e. 1.5.
  *
- * @param key The key to search for in the JSON object.
- * @param value A pointer to an boolean to store the retrieved value.
- * @param json The JSON string to search.
- * @param tokens The parsed JSON tokens.
- * @param start_token The index of the token to start searching from.
- * @return JSON_ERR_NONE on success, JSONErrorCode on failure.
+ * @param start The first character of the number.
+ * @param end One past the last character of the number.
+ * @param value A pointer to store the decoded value.
+ * @return JSON_ERR_NONE on success, JSON_ERR_RANGE if the value does not fit, JSON_ERR_INVALID if the value is not an integer.
  */
-int json_get_value_b (char *key, bool *value, const char *json, jsmntok_t *tokens, int start_token) {
-  int key_index = json_key_index(tokens, start_token, key, (char*)json);
-  if (key_index < 0 || tokens[key_index].size != 1) {
-    return JSON_ERR_KEY_INVALID;
+int json_parse_uint64 (const char *start, const char *end, uint64_t *value) {
+  bool negative = start < end && *start == '-';
+  if (negative) start += 1;
+  const char *number = start;
+  while (end - start > 1 && *start == '0') start += 1; // leading zeros
+  const char *c = start;
+  uint64_t v = 0;
+  int digits = json_scan_digits(&c, end, &v, 0);
+  if (c < end && (*c == '.' || *c == 'e' || *c == 'E')) {
+    int err = json_parse_integral(number, end, &v);
+    if (err != JSON_ERR_NONE) return err;
+  }
+  else {
+    if (digits == 0 || c != end) return JSON_ERR_INVALID;
+    if (digits > 20) return JSON_ERR_RANGE;
+    if (digits == 20) {
+      // 19 digits always fit, check the last one
+      uint64_t last = (uint64_t)(start[19] - '0');
+      if (v > (UINT64_MAX - last) / 10) return JSON_ERR_RANGE;
+      v = v * 10 + last;
+    }
   }
-  return json_get_index_b(key_index + 1, value, json, tokens);
+  if (negative && v != 0) return JSON_ERR_RANGE;
+  *value = v;
+  return JSON_ERR_NONE;
 }
 
 
 /**
- * Get the boolean value from the JSON string using the given token index.
- * Returns JSON_ERR_NONE on success, JSONErrorCode on failure.
+ * Decode a signed integer from the characters in [start, end) without reading past end.
+ * Integer valued numbers with a fraction or exponent are accepted as by json_parse_uint64.
  *
- * @param index The token index of the boolean value.
- * @param value A pointer to an boolean to store the retrieved value.
- * @param json The JSON string from which the string value will be extracted.
- * @param tokens The parsed JSON tokens.
+ * @param start The first character of the number.
+ * @param end One past the last character of the number.
+ * @param value A pointer to store the decoded value.
+ * @return JSON_ERR_NONE on success, JSON_ERR_RANGE if the value does not fit, JSON_ERR_INVALID if the value is not an integer.
+ */
+int json_parse_int64 (const char *start, const char *end, int64_t *value) {
+  bool negative = start < end && *start == '-';
+  // a second sign is not a number rather than a negative magnitude
+  if (negative && end - start > 1 && start[1] == '-') return JSON_ERR_INVALID;
+  uint64_t magnitude;
+  int err = json_parse_uint64(negative ? start + 1 : start, end, &magnitude);
+  if (err != JSON_ERR_NONE) return err;
+  if (magnitude > (uint64_t)INT64_MAX + (negative ? 1 : 0)) return JSON_ERR_RANGE;
+  *value = negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+  return JSON_ERR_NONE;
+}
+
+
+/**
+ * Decode a JSON number from the characters in [start, end) without reading past end.
+ * Numbers with at most 15 significant digits and a decimal exponent within 22 are converted
+ * exactly in a single floating point operation, other numbers fall back to a correctly
+ * rounded strtod of a bounded copy that does not depend on the locale.
  *
- * @return int JSON_ERR_NONE on success, JSONErrorCode on failure.
+ * @param start The first character of the number.
+ * @param end One past the last character of the number.
+ * @param value A pointer to store the decoded value.
+ * @return JSON_ERR_NONE on success, JSON_ERR_RANGE if the value overflows, JSON_ERR_INVALID if the text is not a number.
  */
-int json_get_index_b (int index, bool *value, const char *json, jsmntok_t *tokens) {
-  jsmntok_t *tok = &tokens[index];
-  if (strncmp(json + tok->start, "true", tok->end - tok->start) == 0) {
-    *value = true;
+int json_parse_double (const char *start, const char *end, double *value) {
+  const char *c = start;
+  bool negative = c < end && *c == '-';
+  if (negative) c += 1;
+  uint64_t mantissa = 0;
+  int digits = json_scan_digits(&c, end, &mantissa, 0);
+  if (digits == 0) return JSON_ERR_INVALID;
+  int exponent = 0;
+  if (c < end && *c == '.') {
+    c += 1;
+    int fraction = json_scan_digits(&c, end, &mantissa, digits);
+    if (fraction == 0) return JSON_ERR_INVALID;
+    exponent -= fraction;
+    digits += fraction;
+  }
+  if (c < end && (*c == 'e' || *c == 'E')) {
+    c += 1;
+    bool exponent_negative = c < end && *c == '-';
+    if (c < end && (*c == '-' || *c == '+')) c += 1;
+    int explicit_exponent = 0;
+    const char *exponent_start = c;
+    for (; c < end && *c >= '0' && *c <= '9'; c++) {
+      if (explicit_exponent < 100000) explicit_exponent = explicit_exponent * 10 + (*c - '0');
+    }
+    if (c == exponent_start) return JSON_ERR_INVALID;
+    exponent += exponent_negative ? -explicit_exponent : explicit_exponent;
+  }
+  if (c != end) return JSON_ERR_INVALID;
+
+  // mantissa only holds all digits when there are at most 19 of them
+  // exact fast path, the mantissa and power of ten are both exact doubles
+  if (digits <= 15 && exponent >= -22 && exponent <= 22) {
+    double d = (double)mantissa;
+    d = exponent < 0 ? d / json_pow10[-exponent] : d * json_pow10[exponent];
+    *value = negative ? -d : d;
     return JSON_ERR_NONE;
-  } 
-  else if (strncmp(json + tok->start, "false", tok->end - tok->start) == 0) {
-    *value = false;
+  }
+  if (digits <= 19 && mantissa == 0) {
+    *value = negative ? -0.0 : 0.0;
     return JSON_ERR_NONE;
   }
-  return JSON_ERR_INVALID;
+
+  // slow path, strtod on a NUL terminated copy using the locale decimal point
+  char local[64];
+  size_t length = end - start;
+  char *copy = length < sizeof(local) ? local : json_malloc(length + 1);
+  if (copy == NULL) return JSON_ERR_MEMORY;
+  memcpy(copy, start, length);
+  copy[length] = '\0';
+  char *dot = memchr(copy, '.', length);
+  if (dot != NULL) *dot = localeconv()->decimal_point[0];
+  errno = 0;
+  double d = strtod(copy, NULL);
+  int err = errno == ERANGE && (d == HUGE_VAL || d == -HUGE_VAL) ? JSON_ERR_RANGE : JSON_ERR_NONE;
+  if (copy != local) json_free(copy);
+  if (err == JSON_ERR_NONE) *value = d;
+  return err;
 }
 
 
-// find the last token index in an object and return the index of the last token in the object or -1 on error
 /**
- * Find the last token index in an object and return the index of the last token in the object or -1 on error.
- * @param tokens The parsed JSON tokens.
+ * Decode a JSON number from the characters in [start, end) into a scaled integer without
+ * using floating point, i.e. 1.235 with 2 scale digits is decoded as 124. The value is rounded
+ * half away from zero at the last scale digit.
+ *
+ * @param start The first character of the number.
+ * @param end One past the last character of the number.
+ * @param value A pointer to store the value multiplied by 10^scale_digits.
+ * @param scale_digits The number of decimal digits to keep after the decimal point, 0 to 18.
+ * @return JSON_ERR_NONE on success, JSON_ERR_RANGE if the scaled value does not fit, JSON_ERR_INVALID if the text is not a number.
+ */
+int json_parse_fixed (const char *start, const char *end, int64_t *value, int scale_digits) {
+  if (scale_digits < 0 || scale_digits > 18) return JSON_ERR_INVALID;
+  const char *c = start;
+  bool negative = c < end && *c == '-';
+  if (negative) c += 1;
+  // validate the number and locate its parts
+  const char *integer = c;
+  while (c < end && *c >= '0' && *c <= '9') c++;
+  int integer_digits = c - integer;
+  if (integer_digits == 0) return JSON_ERR_INVALID;
+  const char *fraction = c;
+  int fraction_digits = 0;
+  if (c < end && *c == '.') {
+    fraction = ++c;
+    while (c < end && *c >= '0' && *c <= '9') c++;
+    fraction_digits = c - fraction;
+    if (fraction_digits == 0) return JSON_ERR_INVALID;
+  }
+  int exponent = 0;
+  if (c < end && (*c == 'e' || *c == 'E')) {
+    c += 1;
+    bool exponent_negative = c < end && *c == '-';
+    if (c < end && (*c == '-' || *c == '+')) c += 1;
+    const char *exponent_start = c;
+    for (; c < end && *c >= '0' && *c <= '9'; c++) {
+      if (exponent < 10000) exponent = exponent * 10 + (*c - '0');
+    }
+    if (c == exponent_start) return JSON_ERR_INVALID;
+    if (exponent_negative) exponent = -exponent;
+  }
+  if (c != end) return JSON_ERR_INVALID;
+
+  // the digits form an integer that is scaled by 10^shift
+  int digit_count = integer_digits + fraction_digits;
+  int shift = exponent - fraction_digits + scale_digits;
+  int keep = shift < 0 ? digit_count + shift : digit_count;
+  if (keep < 0) {
+    // every digit is below the rounding position
+    *value = 0;
+    return JSON_ERR_NONE;
+  }
+  // the limit is compared without dividing at run time, the RP2040 has no 64 bit divider
+  const uint64_t limit = negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+  const uint64_t limit_tenth = (uint64_t)INT64_MAX / 10;
+  const uint64_t limit_digit = negative ? 8 : 7;
+  uint64_t magnitude = 0;
+  int round_digit = 0;
+  for (int i = 0; i < digit_count; i++) {
+    int d = i < integer_digits ? integer[i] - '0' : fraction[i - integer_digits] - '0';
+    if (i == keep) {
+      round_digit = d;
+      break;
+    }
+    if (magnitude > limit_tenth || (magnitude == limit_tenth && (uint64_t)d > limit_digit)) {
+      return JSON_ERR_RANGE;
+    }
+    magnitude = magnitude * 10 + d;
+  }
+  for (; shift > 0 && magnitude != 0; shift--) {
+    if (magnitude > limit_tenth) return JSON_ERR_RANGE;
+    magnitude *= 10;
+  }
+  if (round_digit >= 5) {
+    if (magnitude == limit) return JSON_ERR_RANGE;
+    magnitude += 1;
+  }
+  *value = negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+  return JSON_ERR_NONE;
+}
+
+
+// append bytes to the output, counting but not writing those beyond the capacity
+static void json_unescape_emit (char *dst, size_t capacity, size_t *out, const char *bytes, size_t count) {
+  if (*out < capacity) {
+    size_t fit = capacity - *out < count ? capacity - *out : count;
+    memmove(dst + *out, bytes, fit);
+  }
+  *out += count;
+}
+
+
+// decode the four hex digits of a \u escape, returns -1 if they are not hex digits
+static long json_unescape_hex4 (const char *c) {
+  long code = 0;
+  for (int i = 0; i < 4; i++) {
+    char h = c[i];
+    code <<= 4;
+    if (h >= '0' && h <= '9') code |= h - '0';
+    else if (h >= 'a' && h <= 'f') code |= h - 'a' + 10;
+    else if (h >= 'A' && h <= 'F') code |= h - 'A' + 10;
+    else return -1;
+  }
+  return code;
+}
+
+
+// decode the escape sequence at src[*i], a backslash, and append the UTF-8 bytes
+static int json_unescape_sequence (const char *src, size_t length, size_t *i, char *dst, size_t capacity, size_t *out) {
+  if (*i + 1 >= length) return JSON_ERR_INVALID;
+  char utf8[4];
+  char c = src[*i + 1];
+  *i += 2;
+  switch (c) {
+    case '"': case '\\': case '/':
+      utf8[0] = c;
+      break;
+    case 'b': utf8[0] = '\b'; break;
+    case 'f': utf8[0] = '\f'; break;
+    case 'n': utf8[0] = '\n'; break;
+    case 'r': utf8[0] = '\r'; break;
+    case 't': utf8[0] = '\t'; break;
+    case 'u': {
+      if (*i + 4 > length) return JSON_ERR_INVALID;
+      long code = json_unescape_hex4(src + *i);
+      if (code < 0) return JSON_ERR_INVALID;
+      *i += 4;
+      if (code >= 0xD800 && code <= 0xDBFF) {
+        // a high surrogate must be followed by an escaped low surrogate
+        if (*i + 6 > length || src[*i] != '\\' || src[*i + 1] != 'u') return JSON_ERR_INVALID;
+        long low = json_unescape_hex4(src + *i + 2);
+        if (low < 0xDC00 || low > 0xDFFF) return JSON_ERR_INVALID;
+        *i += 6;
+        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+      }
+      else if (code >= 0xDC00 && code <= 0xDFFF) {
+        return JSON_ERR_INVALID;
+      }
+      size_t count;
+      if (code < 0x80) {
+        utf8[0] = (char)code;
+        count = 1;
+      }
+      else if (code < 0x800) {
+        utf8[0] = (char)(0xC0 | (code >> 6));
+        utf8[1] = (char)(0x80 | (code & 0x3F));
+        count = 2;
+      }
+      else if (code < 0x10000) {
+        utf8[0] = (char)(0xE0 | (code >> 12));
+        utf8[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+        utf8[2] = (char)(0x80 | (code & 0x3F));
+        count = 3;
+      }
+      else {
+        utf8[0] = (char)(0xF0 | (code >> 18));
+        utf8[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+        utf8[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+        utf8[3] = (char)(0x80 | (code & 0x3F));
+        count = 4;
+      }
+      json_unescape_emit(dst, capacity, out, utf8, count);
+      return JSON_ERR_NONE;
+    }
+    default:
+      return JSON_ERR_INVALID;
+  }
+  json_unescape_emit(dst, capacity, out, utf8, 1);
+  return JSON_ERR_NONE;
+}
+
+
+/**
+ * Decode the escape sequences of a JSON string one character at a time. This is the
+ * reference implementation for json_unescape and gives identical results.
+ *
+ * @param src The raw string characters between the quotes.
+ * @param length The number of raw characters.
+ * @param dst The buffer for the decoded UTF-8 characters, may be src to decode in place.
+ * @param capacity The size of dst in bytes, the output is not NUL terminated.
+ * @param out_length A pointer set to the decoded length, also when truncated.
+ * @return JSON_ERR_NONE on success, JSON_ERR_TRUNCATED if dst is too small, JSON_ERR_INVALID for a malformed escape.
+ */
+int json_unescape_scalar (const char *src, size_t length, char *dst, size_t capacity, size_t *out_length) {
+  size_t out = 0;
+  size_t i = 0;
+  while (i < length) {
+    if (src[i] == '\\') {
+      int err = json_unescape_sequence(src, length, &i, dst, capacity, &out);
+      if (err != JSON_ERR_NONE) return err;
+    }
+    else {
+      json_unescape_emit(dst, capacity, &out, src + i, 1);
+      i += 1;
+    }
+  }
+  if (out_length) *out_length = out;
+  return out <= capacity ? JSON_ERR_NONE : JSON_ERR_TRUNCATED;
+}
+
+
+// find the next backslash in [c, end), comparing a vector or a word of characters at a time
+static const char * json_find_backslash (const char *c, const char *end) {
+#if defined(__AVX2__)
+  const __m256i backslash = _mm256_set1_epi8('\\');
+  for (; end - c >= 32; c += 32) {
+    __m256i chunk = _mm256_loadu_si256((const __m256i *)c);
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, backslash));
+    if (mask) return c + __builtin_ctz(mask);
+  }
+#elif defined(__SSE2__)
+  const __m128i backslash = _mm_set1_epi8('\\');
+  for (; end - c >= 16; c += 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)c);
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, backslash));
+    if (mask) return c + __builtin_ctz(mask);
+  }
+#elif defined(__ARM_NEON)
+  const uint8x16_t backslash = vdupq_n_u8('\\');
+  for (; end - c >= 16; c += 16) {
+    uint8x16_t match = vceqq_u8(vld1q_u8((const uint8_t *)c), backslash);
+    // narrow each 8 bit lane to 4 bits so the match mask fits in 64 bits
+    uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(match), 4)), 0);
+    if (mask) return c + (__builtin_ctzll(mask) >> 2);
+  }
+#else
+  // test a word at a time for a zero byte after xor with the backslash pattern
+  const uintptr_t ones = (uintptr_t)-1 / 0xFF;
+  const uintptr_t pattern = ones * '\\';
+  for (; end - c >= (ptrdiff_t)sizeof(uintptr_t); c += sizeof(uintptr_t)) {
+    uintptr_t word;
+    memcpy(&word, c, sizeof(word));
+    word ^= pattern;
+    if ((word - ones) & ~word & (ones << 7)) break;
+  }
+#endif
+  while (c < end && *c != '\\') c++;
+  return c;
+}
+
+
+/**
+ * Decode the escape sequences of a JSON string into UTF-8. Runs without escapes are found a
+ * vector (SSE2, AVX2 or NEON) or a word at a time and copied in bulk.
+ *
+ * @param src The raw string characters between the quotes.
+ * @param length The number of raw characters.
+ * @param dst The buffer for the decoded UTF-8 characters, may be src to decode in place.
+ * @param capacity The size of dst in bytes, the output is not NUL terminated.
+ * @param out_length A pointer set to the decoded length, also when truncated.
+ * @return JSON_ERR_NONE on success, JSON_ERR_TRUNCATED if dst is too small, JSON_ERR_INVALID for a malformed escape.
+ */
+int json_unescape (const char *src, size_t length, char *dst, size_t capacity, size_t *out_length) {
+  size_t out = 0;
+  size_t i = 0;
+  while (i < length) {
+    const char *backslash = json_find_backslash(src + i, src + length);
+    size_t run = backslash - (src + i);
+    if (run) {
+      json_unescape_emit(dst, capacity, &out, src + i, run);
+      i += run;
+    }
+    if (i < length) {
+      int err = json_unescape_sequence(src, length, &i, dst, capacity, &out);
+      if (err != JSON_ERR_NONE) return err;
+    }
+  }
+  if (out_length) *out_length = out;
+  return out <= capacity ? JSON_ERR_NONE : JSON_ERR_TRUNCATED;
+}
+
+
+/**
+ * Copy the decoded string value for the given key into a caller supplied buffer.
+ * Escape sequences are decoded to UTF-8 and the value is NUL terminated.
+ *
+ * @param key The key for which the value should be retrieved.
+ * @param buffer The buffer to copy the NUL terminated value into.
+ * @param capacity The size of the buffer in bytes.
+ * @param length A pointer set to the decoded length of the value, excluding the NUL terminator, may be NULL.
+ * @param json The JSON string from which the value should be retrieved.
+ * @param tokens The parsed JSON tokens.
+ * @param start_token The index of the token from which the search should start.
+ *
+ * @return int JSON_ERR_NONE on success, JSON_ERR_TRUNCATED if the buffer is too small, JSONErrorCode on failure.
+*/
+int json_get_value_unescaped (char *key, char *buffer, size_t capacity, size_t *length, const char *json, json_token_t *tokens, int start_token) {
+  int value_index = json_value_index(tokens, start_token, key, (char*)json);
+  if (value_index < 0) {
+    return JSON_ERR_KEY_INVALID;
+  }
+  return json_get_index_unescaped(value_index, buffer, capacity, length, json, tokens);
+}
+
+
+/**
+ * Copy the decoded string value at the given token index into a caller supplied buffer.
+ * Escape sequences are decoded to UTF-8 and the value is NUL terminated. On truncation
+ * length is set to the full decoded length so the caller can size a larger buffer.
+ *
+ * @param index The token index of the string value.
+ * @param buffer The buffer to copy the NUL terminated value into.
+ * @param capacity The size of the buffer in bytes.
+ * @param length A pointer set to the decoded length of the value, excluding the NUL terminator, may be NULL.
+ * @param json The JSON string from which the string value will be extracted.
+ * @param tokens The parsed JSON tokens.
+ *
+ * @return int JSON_ERR_NONE on success, JSON_ERR_TRUNCATED if the buffer is too small, JSONErrorCode on failure.
+ */
+int json_get_index_unescaped (int index, char *buffer, size_t capacity, size_t *length, const char *json, json_token_t *tokens) {
+  size_t decoded = 0;
+  size_t room = capacity ? capacity - 1 : 0;
+  int err = json_unescape(json + json_tok_start(&tokens[index]), json_tok_end(&tokens[index]) - json_tok_start(&tokens[index]), buffer, room, &decoded);
+  if (length) *length = decoded;
+  if (err == JSON_ERR_INVALID) return err;
+  if (!buffer || capacity == 0) return JSON_ERR_TRUNCATED;
+  buffer[decoded < room ? decoded : room] = '\0';
+  JSON_STATS_ADD(copied_bytes, decoded < room ? decoded : room);
+  return err;
+}
+
+
+/**
+ * Decode the string value at the given token index in place in a mutable JSON string.
+ * The token end is moved to the end of the decoded value so later getters see the decoded
+ * characters. The decoded value is not NUL terminated and must only be decoded once.
+ *
+ * @param index The token index of the string value.
+ * @param value A pointer to the view to set to the decoded value, may be NULL.
+ * @param json The mutable JSON string.
+ * @param tokens The parsed JSON tokens.
+ *
+ * @return int JSON_ERR_NONE on success, JSONErrorCode on failure.
+ */
+int json_unescape_index (int index, json_string_view_t *value, char *json, json_token_t *tokens) {
+  char *start = json + json_tok_start(&tokens[index]);
+  size_t length = json_tok_end(&tokens[index]) - json_tok_start(&tokens[index]);
+  size_t decoded = 0;
+  int err = json_unescape(start, length, start, length, &decoded);
+  if (err != JSON_ERR_NONE) return err;
+  json_tok_set_end(&tokens[index], json_tok_start(&tokens[index]) + (int)decoded);
+  if (value) {
+    value->ptr = start;
+    value->len = decoded;
+  }
+  return JSON_ERR_NONE;
+}
+
+
+/**
+ * Retrieve an integer value from a JSON object at the given key. A fraction is truncated
+ * toward zero, see json_get_index_i.
+ *
+ * @param key The key to search for in the JSON object.
+ * @param value A pointer to an integer to store the retrieved value.
+ * @param json The JSON string to search.
+ * @param tokens The parsed JSON tokens.
+ * @param start_token The index of the token to start searching from.
+ * @return JSON_ERR_NONE on success, JSONErrorCode on failure.
+ */
+int json_get_value_i (char *key, int *value, const char *json, json_token_t *tokens, int start_token) {
+  int value_index = json_value_index(tokens, start_token, key, (char*)json);
+  if (value_index < 0) {
+    return JSON_ERR_KEY_INVALID;
+  }
+  return json_get_index_i(value_index, value, json, tokens);
+}
+
+
+/**
+ * Get the integer value from the JSON string using the given token index.
+ * Integer valued numbers are decoded exactly, i.e. 1e3 is 1000. Other numbers are truncated
+ * toward zero as atoi read them before, i.e. 1.23 is 1 and -1.5 is -1, use json_get_index_i64
+ * to reject a fraction.
+ * Returns JSON_ERR_NONE on success, JSONErrorCode on failure.
+ *
+ * @param index The token index of the integer value.
+ * @param value A pointer to an integer to store the retrieved value.
+ * @param json The JSON string from which the string value will be extracted.
+ * @param tokens The parsed JSON tokens.
+ *
+ * @return int JSON_ERR_NONE on success, JSONErrorCode on failure.
+ */
+int json_get_index_i (int index, int *value, const char *json, json_token_t *tokens) {
+  const char *start = json + json_tok_start(&tokens[index]);
+  const char *end = json + json_tok_end(&tokens[index]);
+  int64_t v;
+  int err = json_parse_int64(start, end, &v);
+  if (err == JSON_ERR_INVALID) {
+    double d;
+    err = json_parse_double(start, end, &d);
+    if (err != JSON_ERR_NONE) return err;
+    if (!(d > (double)INT_MIN - 1 && d < (double)INT_MAX + 1)) return JSON_ERR_RANGE;
+    *value = (int)d;
+    return JSON_ERR_NONE;
+  }
+  if (err != JSON_ERR_NONE) return err;
+  if (v < INT_MIN || v > INT_MAX) return JSON_ERR_RANGE;
+  *value = (int)v;
+  return JSON_ERR_NONE;
+}
+
+
+/**
+ * Retrieve a 64 bit integer value from a JSON object at the given key.
+ *
+ * @param key The key to search for in the JSON object.
+ * @param value A pointer to an integer to store the retrieved value.
+ * @param json The JSON string to search.
+ * @param tokens The parsed JSON tokens.
+ * @param start_token The index of the token to start searching from.
+ * @return JSON_ERR_NONE on success, JSONErrorCode on failure.
+ */
+int json_get_value_i64 (char *key, int64_t *value, const char *json, json_token_t *tokens, int start_token) {
+  int value_index = json_value_index(tokens, start_token, key, (char*)json);
+  if (value_index < 0) {
+    return JSON_ERR_KEY_INVALID;
+  }
+  return json_get_index_i64(value_index, value, json, tokens);
+}
+
+
+/**
+ * Get the 64 bit integer value from the JSON string using the given token index.
+ *
+ * @param index The token index of the integer value.
+ * @param value A pointer to an integer to store the retrieved value.
+ * @param json The JSON string from which the value will be extracted.
+ * @param tokens The parsed JSON tokens.
+ * @return int JSON_ERR_NONE on success, JSON_ERR_RANGE if the value does not fit, JSONErrorCode on failure.
+ */
+int json_get_index_i64 (int index, int64_t *value, const char *json, json_token_t *tokens) {
+  return json_parse_int64(json + json_tok_start(&tokens[index]), json + json_tok_end(&tokens[index]), value);
+}
+
+
+/**
+ * Retrieve an unsigned 64 bit integer value from a JSON object at the given key.
+ *
+ * @param key The key to search for in the JSON object.
+ * @param value A pointer to an integer to store the retrieved value.
+ * @param json The JSON string to search.
+ * @param tokens The parsed JSON tokens.
+ * @param start_token The index of the token to start searching from.
+ * @return JSON_ERR_NONE on success, JSONErrorCode on failure.
+ */
+int json_get_value_u64 (char *key, uint64_t *value, const char *json, json_token_t *tokens, int start_token) {
+  int value_index = json_value_index(tokens, start_token, key, (char*)json);
+  if (value_index < 0) {
+    return JSON_ERR_KEY_INVALID;
+  }
+  return json_get_index_u64(value_index, value, json, tokens);
+}
+
+
+/**
+ * Get the unsigned 64 bit integer value from the JSON string using the given token index.
+ *
+ * @param index The token index of the integer value.
+ * @param value A pointer to an integer to store the retrieved value.
+ * @param json The JSON string from which the value will be extracted.
+ * @param tokens The parsed JSON tokens.
+ * @return int JSON_ERR_NONE on success, JSON_ERR_RANGE if the value does not fit, JSONErrorCode on failure.
+ */
+int json_get_index_u64 (int index, uint64_t *value, const char *json, json_token_t *tokens) {
+  return json_parse_uint64(json + json_tok_start(&tokens[index]), json + json_tok_end(&tokens[index]), value);
+}
+
+
+/**
+ * Retrieve an unsigned 32 bit integer value from a JSON object at the given key.
+ *
+ * @param key The key to search for in the JSON object.
+ * @param value A pointer to an integer to store the retrieved value.
+ * @param json The JSON string to search.
+ * @param tokens The parsed JSON tokens.
+ * @param start_token The index of the token to start searching from.
+ * @return JSON_ERR_NONE on success, JSONErrorCode on failure.
+ */
+int json_get_value_u32 (char *key, uint32_t *value, const char *json, json_token_t *tokens, int start_token) {
+  int value_index = json_value_index(tokens, start_token, key, (char*)json);
+  if (value_index < 0) {
+    return JSON_ERR_KEY_INVALID;
+  }
+  return json_get_index_u32(value_index, value, json, tokens);
+}
+
+
+/**
+ * Get the unsigned 32 bit integer value from the JSON string using the given token index.
+ *
+ * @param index The token index of the integer value.
+ * @param value A pointer to an integer to store the retrieved value.
+ * @param json The JSON string from which the value will be extracted.
+ * @param tokens The parsed JSON tokens.
+ * @return int JSON_ERR_NONE on success, JSON_ERR_RANGE if the value does not fit, JSONErrorCode on failure.
+ */
+int json_get_index_u32 (int index, uint32_t *value, const char *json, json_token_t *tokens) {
+  uint64_t v;
+  int err = json_parse_uint64(json + json_tok_start(&tokens[index]), json + json_tok_end(&tokens[index]), &v);
+  if (err != JSON_ERR_NONE) return err;
+  if (v > UINT32_MAX) return JSON_ERR_RANGE;
+  *value = (uint32_t)v;
+  return JSON_ERR_NONE;
+}
+
+
+/**
+ * Retrieve an double value from a JSON object at the given key.
+ *
+ * @param key The key to search for in the JSON object.
+ * @param value A pointer to an double to store the retrieved value.
+ * @param json The JSON string to search.
+ * @param tokens The parsed JSON tokens.
+ * @param start_token The index of the token to start searching from.
+ * @return JSON_ERR_NONE on success, JSONErrorCode on failure.
+ */
+int json_get_value_d (char *key, double *value, const char *json, json_token_t *tokens, int start_token) {
+  int value_index = json_value_index(tokens, start_token, key, (char*)json);
+  if (value_index < 0) {
+    return JSON_ERR_KEY_INVALID;
+  }
+  return json_get_index_d(value_index, value, json, tokens);
+}
+
+
+/**
+ * Get the double value from the JSON string using the given token index.
+ * Returns JSON_ERR_NONE on success, JSONErrorCode on failure.
+ *
+ * @param index The token index of the double value.
+ * @param value A pointer to an double to store the retrieved value.
+ * @param json The JSON string from which the string value will be extracted.
+ * @param tokens The parsed JSON tokens.
+ *
+ * @return int JSON_ERR_NONE on success, JSONErrorCode on failure.
+ */
+int json_get_index_d (int index, double *value, const char *json, json_token_t *tokens) {
+  return json_parse_double(json + json_tok_start(&tokens[index]), json + json_tok_end(&tokens[index]), value);
+}
+
+
+/**
+ * Retrieve a float value from a JSON object at the given key.
+ *
+ * @param key The key to search for in the JSON object.
+ * @param value A pointer to a float to store the retrieved value.
+ * @param json The JSON string to search.
+ * @param tokens The parsed JSON tokens.
+ * @param start_token The index of the token to start searching from.
+ * @return JSON_ERR_NONE on success, JSONErrorCode on failure.
+ */
+int json_get_value_f (char *key, float *value, const char *json, json_token_t *tokens, int start_token) {
+  int value_index = json_value_index(tokens, start_token, key, (char*)json);
+  if (value_index < 0) {
+    return JSON_ERR_KEY_INVALID;
+  }
+  return json_get_index_f(value_index, value, json, tokens);
+}
+
+
+/**
+ * Get the float value from the JSON string using the given token index.
+ *
+ * @param index The token index of the float value.
+ * @param value A pointer to a float to store the retrieved value.
+ * @param json The JSON string from which the value will be extracted.
+ * @param tokens The parsed JSON tokens.
+ * @return int JSON_ERR_NONE on success, JSON_ERR_RANGE if the value overflows a float, JSONErrorCode on failure.
+ */
+int json_get_index_f (int index, float *value, const char *json, json_token_t *tokens) {
+  double d;
+  int err = json_parse_double(json + json_tok_start(&tokens[index]), json + json_tok_end(&tokens[index]), &d);
+  if (err != JSON_ERR_NONE) return err;
+  if (d > FLT_MAX || d < -FLT_MAX) return JSON_ERR_RANGE;
+  *value = (float)d;
+  return JSON_ERR_NONE;
+}
+
+
+/**
+ * Retrieve a fixed point value from a JSON object at the given key. The decimal value is
+ * decoded directly into an integer scaled by 10^scale_digits without floating point.
+ *
+ * @param key The key to search for in the JSON object.
+ * @param value A pointer to an integer to store the scaled value.
+ * @param scale_digits The number of decimal digits to keep after the decimal point, 0 to 18.
+ * @param json The JSON string to search.
+ * @param tokens The parsed JSON tokens.
+ * @param start_token The index of the token to start searching from.
+ * @return JSON_ERR_NONE on success, JSONErrorCode on failure.
+ */
+int json_get_value_fixed (char *key, int64_t *value, int scale_digits, const char *json, json_token_t *tokens, int start_token) {
+  int value_index = json_value_index(tokens, start_token, key, (char*)json);
+  if (value_index < 0) {
+    return JSON_ERR_KEY_INVALID;
+  }
+  return json_get_index_fixed(value_index, value, scale_digits, json, tokens);
+}
+
+
+/**
+ * Get the fixed point value from the JSON string using the given token index.
+ *
+ * @param index The token index of the number value.
+ * @param value A pointer to an integer to store the scaled value.
+ * @param scale_digits The number of decimal digits to keep after the decimal point, 0 to 18.
+ * @param json The JSON string from which the value will be extracted.
+ * @param tokens The parsed JSON tokens.
+ * @return int JSON_ERR_NONE on success, JSON_ERR_RANGE if the scaled value does not fit, JSONErrorCode on failure.
+ */
+int json_get_index_fixed (int index, int64_t *value, int scale_digits, const char *json, json_token_t *tokens) {
+  return json_parse_fixed(json + json_tok_start(&tokens[index]), json + json_tok_end(&tokens[index]), value, scale_digits);
+}
+
+
+/**
+ * Retrieve an boolean value from a JSON object at the given key.
+ *
+ * @param key The key to search for in the JSON object.
+ * @param value A pointer to an boolean to store the retrieved value.
+ * @param json The JSON string to search.
+ * @param tokens The parsed JSON tokens.
+ * @param start_token The index of the token to start searching from.
+ * @return JSON_ERR_NONE on success, JSONErrorCode on failure.
+ */
+int json_get_value_b (char *key, bool *value, const char *json, json_token_t *tokens, int start_token) {
+  int value_index = json_value_index(tokens, start_token, key, (char*)json);
+  if (value_index < 0) {
+    return JSON_ERR_KEY_INVALID;
+  }
+  return json_get_index_b(value_index, value, json, tokens);
+}
+
+
+/**
+ * Get the boolean value from the JSON string using the given token index.
+ * Returns JSON_ERR_NONE on success, JSONErrorCode on failure.
+ *
+ * @param index The token index of the boolean value.
+ * @param value A pointer to an boolean to store the retrieved value.
+ * @param json The JSON string from which the string value will be extracted.
+ * @param tokens The parsed JSON tokens.
+ *
+ * @return int JSON_ERR_NONE on success, JSONErrorCode on failure.
+ */
+int json_get_index_b (int index, bool *value, const char *json, json_token_t *tokens) {
+  json_token_t *tok = &tokens[index];
+  int length = json_tok_end(tok) - json_tok_start(tok);
+  if (length == 4 && strncmp(json + json_tok_start(tok), "true", length) == 0) {
+    *value = true;
+    return JSON_ERR_NONE;
+  } 
+  else if (length == 5 && strncmp(json + json_tok_start(tok), "false", length) == 0) {
+    *value = false;
+    return JSON_ERR_NONE;
+  }
+  return JSON_ERR_INVALID;
+}
+
+
+// find the array at key, returning its element count and the index of its first element token
+static int json_array_elements (char *key, const char *json, json_token_t *tokens, int start_token, int *first) {
+  int value_index = json_value_index(tokens, start_token, key, (char*)json);
+  if (value_index < 0) return JSON_ERR_KEY_INVALID;
+  if (json_tok_type(&tokens[value_index]) != JSMN_ARRAY) return JSON_ERR_INVALID;
+  *first = value_index + 1;
+  return json_tok_size(&tokens[value_index]);
+}
+
+
+// decode a short integer token, up to eight digits are converted in one step
+static int json_array_integer (const char *json, json_token_t *tok, int64_t *value) {
+  if (json_tok_type(tok) != JSMN_PRIMITIVE) return JSON_ERR_INVALID;
+  const char *start = json + json_tok_start(tok);
+  const char *end = json + json_tok_end(tok);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  bool negative = start < end && *start == '-';
+  size_t digits = end - start - negative;
+  if (digits > 0 && digits <= 8) {
+    // right align the digits over a word of '0' characters
+    uint64_t chunk = 0x3030303030303030ULL;
+    memcpy((char *)&chunk + 8 - digits, start + negative, digits);
+    if (json_is_eight_digits(chunk)) {
+      int64_t v = json_eight_digits(chunk);
+      *value = negative ? -v : v;
+      return JSON_ERR_NONE;
+    }
+  }
+#endif
+  return json_parse_int64(start, end, value);
+}
+
+
+/**
+ * Decode an array of integers at the given key into a caller supplied array in a single pass.
+ * Integers of up to eight digits are converted without a per digit loop.
+ *
+ * @param key The key of the array.
+ * @param values The array to store the decoded values.
+ * @param capacity The number of values the array can hold.
+ * @param count Set to the number of values decoded, on an element error it is the index of the offending element.
+ * @param json The JSON string.
+ * @param tokens The parsed JSON tokens.
+ * @param start_token The index of the token to start searching from.
+ * @return JSON_ERR_NONE on success, JSON_ERR_TRUNCATED if the array has more than capacity elements,
+ *   JSON_ERR_INVALID or JSON_ERR_RANGE for an element that is not an integer or does not fit, JSONErrorCode on failure.
+ */
+int json_get_array_i32 (char *key, int32_t *values, size_t capacity, size_t *count, const char *json, json_token_t *tokens, int start_token) {
+  int first;
+  *count = 0;
+  int size = json_array_elements(key, json, tokens, start_token, &first);
+  if (size < 0) return size;
+  size_t limit = (size_t)size < capacity ? (size_t)size : capacity;
+  // elements before the first non numeric element are consecutive primitive tokens
+  for (size_t i = 0; i < limit; i++) {
+    int64_t value;
+    int err = json_array_integer(json, &tokens[first + i], &value);
+    if (err == JSON_ERR_NONE && (value < INT32_MIN || value > INT32_MAX)) err = JSON_ERR_RANGE;
+    if (err != JSON_ERR_NONE) {
+      *count = i;
+      return err;
+    }
+    values[i] = (int32_t)value;
+  }
+  *count = limit;
+  return limit < (size_t)size ? JSON_ERR_TRUNCATED : JSON_ERR_NONE;
+}
+
+
+/**
+ * Decode an array of 64 bit integers at the given key into a caller supplied array in a single pass.
+ *
+ * @param key The key of the array.
+ * @param values The array to store the decoded values.
+ * @param capacity The number of values the array can hold.
+ * @param count Set to the number of values decoded, on an element error it is the index of the offending element.
+ * @param json The JSON string.
+ * @param tokens The parsed JSON tokens.
+ * @param start_token The index of the token to start searching from.
+ * @return JSON_ERR_NONE on success, JSON_ERR_TRUNCATED if the array has more than capacity elements,
+ *   JSON_ERR_INVALID or JSON_ERR_RANGE for an element that is not an integer or does not fit, JSONErrorCode on failure.
+ */
+int json_get_array_i64 (char *key, int64_t *values, size_t capacity, size_t *count, const char *json, json_token_t *tokens, int start_token) {
+  int first;
+  *count = 0;
+  int size = json_array_elements(key, json, tokens, start_token, &first);
+  if (size < 0) return size;
+  size_t limit = (size_t)size < capacity ? (size_t)size : capacity;
+  for (size_t i = 0; i < limit; i++) {
+    int err = json_array_integer(json, &tokens[first + i], &values[i]);
+    if (err != JSON_ERR_NONE) {
+      *count = i;
+      return err;
+    }
+  }
+  *count = limit;
+  return limit < (size_t)size ? JSON_ERR_TRUNCATED : JSON_ERR_NONE;
+}
+
+
+/**
+ * Decode an array of numbers at the given key into a caller supplied array of doubles in a single pass.
+ *
+ * @param key The key of the array.
+ * @param values The array to store the decoded values.
+ * @param capacity The number of values the array can hold.
+ * @param count Set to the number of values decoded, on an element error it is the index of the offending element.
+ * @param json The JSON string.
+ * @param tokens The parsed JSON tokens.
+ * @param start_token The index of the token to start searching from.
+ * @return JSON_ERR_NONE on success, JSON_ERR_TRUNCATED if the array has more than capacity elements,
+ *   JSON_ERR_INVALID or JSON_ERR_RANGE for an element that is not a number or overflows, JSONErrorCode on failure.
+ */
+int json_get_array_f64 (char *key, double *values, size_t capacity, size_t *count, const char *json, json_token_t *tokens, int start_token) {
+  int first;
+  *count = 0;
+  int size = json_array_elements(key, json, tokens, start_token, &first);
+  if (size < 0) return size;
+  size_t limit = (size_t)size < capacity ? (size_t)size : capacity;
+  for (size_t i = 0; i < limit; i++) {
+    json_token_t *tok = &tokens[first + i];
+    int err = json_tok_type(tok) == JSMN_PRIMITIVE ? json_parse_double(json + json_tok_start(tok), json + json_tok_end(tok), &values[i]) : JSON_ERR_INVALID;
+    if (err != JSON_ERR_NONE) {
+      *count = i;
+      return err;
+    }
+  }
+  *count = limit;
+  return limit < (size_t)size ? JSON_ERR_TRUNCATED : JSON_ERR_NONE;
+}
+
+
+/**
+ * Decode an array of booleans at the given key into a caller supplied array in a single pass.
+ *
+ * @param key The key of the array.
+ * @param values The array to store the decoded values.
+ * @param capacity The number of values the array can hold.
+ * @param count Set to the number of values decoded, on an element error it is the index of the offending element.
+ * @param json The JSON string.
+ * @param tokens The parsed JSON tokens.
+ * @param start_token The index of the token to start searching from.
+ * @return JSON_ERR_NONE on success, JSON_ERR_TRUNCATED if the array has more than capacity elements,
+ *   JSON_ERR_INVALID for an element that is not true or false, JSONErrorCode on failure.
+ */
+int json_get_array_bool (char *key, bool *values, size_t capacity, size_t *count, const char *json, json_token_t *tokens, int start_token) {
+  int first;
+  *count = 0;
+  int size = json_array_elements(key, json, tokens, start_token, &first);
+  if (size < 0) return size;
+  size_t limit = (size_t)size < capacity ? (size_t)size : capacity;
+  for (size_t i = 0; i < limit; i++) {
+    json_token_t *tok = &tokens[first + i];
+    int err = json_tok_type(tok) == JSMN_PRIMITIVE ? json_get_index_b(first + i, &values[i], json, tokens) : JSON_ERR_INVALID;
+    if (err != JSON_ERR_NONE) {
+      *count = i;
+      return err;
+    }
+  }
+  *count = limit;
+  return limit < (size_t)size ? JSON_ERR_TRUNCATED : JSON_ERR_NONE;
+}
+
+
+/**
+ * Get the string value at a compiled key path.
+ * NOTE: The caller is responsible for freeing the allocated memory with json_free.
+ *
+ * @param path The compiled key path.
+ * @param value A pointer to a char pointer that will be set to the value.
+ * @param json The JSON string from which the value should be retrieved.
+ * @param tokens The parsed JSON tokens.
+ * @param start_token The index of the token from which the search should start.
+ * @return JSON_ERR_NONE on success, JSONErrorCode on failure.
+ */
+int json_get_path_s (const json_path_t *path, char **value, const char *json, json_token_t *tokens, int start_token) {
+  int value_index = json_path_value_index(path, json, tokens, start_token);
+  if (value_index < 0) {
+    return JSON_ERR_KEY_INVALID;
+  }
+  return json_get_index_s(value_index, value, json, tokens);
+}
+
+
+/**
+ * Get the integer value at a compiled key path.
+ *
+ * @param path The compiled key path.
+ * @param value A pointer to an integer to store the retrieved value.
+ * @param json The JSON string to search.
+ * @param tokens The parsed JSON tokens.
+ * @param start_token The index of the token to start searching from.
+ * @return JSON_ERR_NONE on success, JSONErrorCode on failure.
+ */
+int json_get_path_i (const json_path_t *path, int *value, const char *json, json_token_t *tokens, int start_token) {
+  int value_index = json_path_value_index(path, json, tokens, start_token);
+  if (value_index < 0) {
+    return JSON_ERR_KEY_INVALID;
+  }
+  return json_get_index_i(value_index, value, json, tokens);
+}
+
+
+/**
+ * Get the double value at a compiled key path.
+ *
+ * @param path The compiled key path.
+ * @param value A pointer to a double to store the retrieved value.
+ * @param json The JSON string to search.
+ * @param tokens The parsed JSON tokens.
+ * @param start_token The index of the token to start searching from.
+ * @return JSON_ERR_NONE on success, JSONErrorCode on failure.
+ */
+int json_get_path_d (const json_path_t *path, double *value, const char *json, json_token_t *tokens, int start_token) {
+  int value_index = json_path_value_index(path, json, tokens, start_token);
+  if (value_index < 0) {
+    return JSON_ERR_KEY_INVALID;
+  }
+  return json_get_index_d(value_index, value, json, tokens);
+}
+
+
+/**
+ * Get the boolean value at a compiled key path.
+ *
+ * @param path The compiled key path.
+ * @param value A pointer to a boolean to store the retrieved value.
+ * @param json The JSON string to search.
+ * @param tokens The parsed JSON tokens.
+ * @param start_token The index of the token to start searching from.
+ * @return JSON_ERR_NONE on success, JSONErrorCode on failure.
+ */
+int json_get_path_b (const json_path_t *path, bool *value, const char *json, json_token_t *tokens, int start_token) {
+  int value_index = json_path_value_index(path, json, tokens, start_token);
+  if (value_index < 0) {
+    return JSON_ERR_KEY_INVALID;
+  }
+  return json_get_index_b(value_index, value, json, tokens);
+}
+
+
+/**
+ * Build a token table for a parsed token array. The table stores the index of the last
+ * token in the subtree of every token so the traversal helpers can step over a value in
+ * constant time.
+ * Set hash_keys on the built table to also cache a key hash table for each object with at
+ * least JSON_KEY_HASH_MIN_KEYS keys, built the first time the object is searched.
+ * Pass the table to json_table_key_index and json_table_value_index, or attach it. An attached
+ * table is matched to its token array by address and is detached when the array is freed,
+ * reallocated or parsed into. Tokens outside token_count fall back to walking the tokens.
+ * Free a built table with json_token_table_free before building it again.
+ * NOTE: The caller is responsible for freeing the table with json_token_table_free.
+ *
+ * @param table The table to build.
+ * @param tokens The parsed JSON tokens.
+ * @param token_count The number of parsed tokens.
+ * @return JSON_ERR_NONE on success, JSONErrorCode on failure.
+ */
+int json_token_table_build (json_token_table_t *table, json_token_t *tokens, int token_count) {
+  table->tokens = tokens;
+  table->token_count = token_count;
+  table->last = NULL;
+  table->hash_keys = false;
+  table->key_hashes = NULL;
+  if (!tokens || token_count <= 0) return JSON_ERR_INVALID;
+  table->last = json_malloc(sizeof(int) * token_count);
+  if (table->last == NULL) return JSON_ERR_MEMORY;
+  // walk backwards so the subtree end of every child is known before its parent
+  for (int i = token_count - 1; i >= 0; i--) {
+    int last = i;
+    for (int child = 0; child < json_tok_size(&tokens[i]); child++) {
+      if (last + 1 >= token_count) {
+        json_token_table_free(table);
+        return JSON_ERR_INVALID;
+      }
+      last = table->last[last + 1];
+    }
+    table->last[i] = last;
+  }
+  return JSON_ERR_NONE;
+}
+
+
+// free the cached key hash tables so they are rebuilt from the current tokens
+static void json_token_table_drop_keys (json_token_table_t *table) {
+  if (table->key_hashes == NULL) return;
+  for (int i = 0; i < table->token_count; i++) json_free(table->key_hashes[i]);
+  json_free(table->key_hashes);
+  table->key_hashes = NULL;
+}
+
+
+/**
+ * Free the memory allocated for a token table, detaching it if it is attached.
+ *
+ * @param table The table to free.
+ */
+void json_token_table_free (json_token_table_t *table) {
+  if (json_active_table == table) json_active_table = NULL;
+  json_token_table_drop_keys(table);
+  json_free(table->last);
+  table->last = NULL;
+}
+
+
+/**
+ * Attach a token table so that lookups on its token array use it. Pass NULL to detach.
+ * With JSON_ENABLE_THREADS the table is attached for the calling thread only. Cached key
+ * hash tables are kept, so a table attached for each request still searches in one probe.
+ * Freeing, reallocating or parsing into the token array detaches the table, prefer
+ * json_table_key_index and json_table_value_index which take the table explicitly.
+ * NOTE: Rebuild the table before attaching it again if its token array was reparsed.
+ *
+ * @param table The token table to attach.
+ */
+void json_token_table_attach (json_token_table_t *table) {
+  json_active_table = table;
+}
+
+
+/**
+ * Detach the attached token table if it describes the token array. The reader calls this when
+ * a token array is freed, reallocated or parsed into, so a new document at the same address
+ * is never searched with the old table. Call it before parsing into a token array with jsmn
+ * directly.
+ *
+ * @param tokens The token array that is about to change.
+ */
+void json_token_table_release (const void *tokens) {
+  if (json_active_table != NULL && tokens != NULL && (const void *)json_active_table->tokens == tokens) json_active_table = NULL;
+}
+
+
+// get the subtree end table for the token array if one is attached and covers the token
+static int * json_table_last (json_token_t *tokens, int start_token) {
+  if (json_active_table != NULL && json_active_table->tokens == tokens &&
+      start_token >= 0 && start_token < json_active_table->token_count) {
+    return json_active_table->last;
+  }
+  return NULL;
+}
+
+
+/**
+ * Find the index of the last token in the subtree of any token.
+ * @param tokens The parsed JSON tokens.
+ * @param start_token The index of the token.
+ * @return The index of the last token in the subtree, start_token for strings and primitives, or JSONErrorCode on error.
+*/
+int json_last_token_index (json_token_t *tokens, int start_token) {
+  int *last = json_table_last(tokens, start_token);
+  if (last != NULL) return last[start_token];
+  switch (json_tok_type(&tokens[start_token])) {
+    case JSMN_OBJECT:
+      return json_last_object_token_index(tokens, start_token);
+    case JSMN_ARRAY:
+      return json_last_array_token_index(tokens, start_token);
+    default:
+      // a key string has its value as a child
+      return json_tok_size(&tokens[start_token]) ? json_last_token_index(tokens, start_token + 1) : start_token;
+  }
+}
+
+
+/**
+ * Find the last token index in an object and return the index of the last token in the object or -1 on error.
+ * @param tokens The parsed JSON tokens.
  * @param start_token The index of the object token.
  * @return The index of the last token in the object or JSONErrorCode on error.
 */
-int json_last_object_token_index (jsmntok_t *tokens, int start_token) {
+int json_last_object_token_index (json_token_t *tokens, int start_token) {
   // start token must be an object to have root tokens
-  if (tokens[start_token].type != JSMN_OBJECT) {
+  if (json_tok_type(&tokens[start_token]) != JSMN_OBJECT) {
     return JSON_ERR_INDEX_INVALID;
   }
+  int *last = json_table_last(tokens, start_token);
+  if (last != NULL) return last[start_token];
   // the number of root tokens in this object is the token child size
-  int token_count = tokens[start_token].size;
+  int token_count = json_tok_size(&tokens[start_token]);
   bool is_key = true; // the next token will naturally be a key
   // process each root token in the object
   while (token_count > 0 || !is_key) {
     start_token += 1;
+    JSON_STATS_ADD(tokens_scanned, 1);
     if (is_key) {
       token_count -= 1;
       is_key = false; // next token will naturally be a value for this key
     }
-    else {
-      if (tokens[start_token].type == JSMN_ARRAY) {
-        // get the last token in the array
-        start_token = json_last_array_token_index(tokens, start_token);
-        if (start_token < 0) return start_token;
-      }
-      else if (tokens[start_token].type == JSMN_OBJECT) {
-        // get last token in the object
-        start_token = json_last_object_token_index(tokens, start_token);
-        if (start_token < 0) return start_token;
+    else {
+      if (json_tok_type(&tokens[start_token]) == JSMN_ARRAY) {
+        // get the last token in the array
+        start_token = json_last_array_token_index(tokens, start_token);
+        if (start_token < 0) return start_token;
+      }
+      else if (json_tok_type(&tokens[start_token]) == JSMN_OBJECT) {
+        // get last token in the object
+        start_token = json_last_object_token_index(tokens, start_token);
+        if (start_token < 0) return start_token;
+      }
+      is_key = true; // next token will be a key
+    }
+  }
+  return start_token;
+}
+
+
+/**
+ * Find the last token index in an array and return the index of the last token in the array or -1 on error.
+ * @param tokens The json_token_t array of tokens.
+ * @param start_token The index of the array token.
+ * @return The index of the last token in the array or JSONErrorCode on error.
+*/
+int json_last_array_token_index (json_token_t *tokens, int start_token) {
+  // start token must be an array
+  if (json_tok_type(&tokens[start_token]) != JSMN_ARRAY) {
+    return JSON_ERR_INDEX_INVALID;
+  }
+  int *last = json_table_last(tokens, start_token);
+  if (last != NULL) return last[start_token];
+  // the number of root tokens in this array is the token child size
+  int token_count = json_tok_size(&tokens[start_token]);
+  // loop through all the tokens in the array
+  while (token_count > 0) {
+    start_token += 1;
+    JSON_STATS_ADD(tokens_scanned, 1);
+    // if token has size then this array value is an array or an object
+    if (json_tok_size(&tokens[start_token])) {
+      if (json_tok_type(&tokens[start_token]) == JSMN_ARRAY) {
+        start_token = json_last_array_token_index(tokens, start_token);
+        if (start_token < 0) return start_token;
+      }
+      else if (json_tok_type(&tokens[start_token]) == JSMN_OBJECT) {
+        start_token = json_last_object_token_index(tokens, start_token);
+        if (start_token < 0) return start_token;
+      }
+      else {
+        return JSON_ERR_INVALID;
+      }
+    }
+    token_count -= 1;
+  }
+  return start_token;
+}
+
+
+/**
+ * Begin iterating the members of an object or the elements of an array in place, without
+ * allocating. Nested values are skipped with json_last_token_index, so an attached token
+ * table makes each step constant time.
+ *
+ * @param it The iterator to initialize.
+ * @param tokens The parsed JSON tokens.
+ * @param index The index of the object or array token.
+ * @return JSON_ERR_NONE on success, JSON_ERR_INDEX_INVALID if the token is not an object or array.
+ */
+int json_iter_begin (json_iter_t *it, json_token_t *tokens, int index) {
+  if (!it || !tokens || index < 0) return JSON_ERR_INDEX_INVALID;
+  if (json_tok_type(&tokens[index]) != JSMN_OBJECT && json_tok_type(&tokens[index]) != JSMN_ARRAY) return JSON_ERR_INDEX_INVALID;
+  it->tokens = tokens;
+  it->container = index;
+  it->remaining = json_tok_size(&tokens[index]);
+  it->next = index + 1;
+  return JSON_ERR_NONE;
+}
+
+
+/**
+ * Step to the next object member or array element.
+ *
+ * @param it The iterator from json_iter_begin.
+ * @param key_token Optional, set to the key token index of an object member or -1 for an array element.
+ * @param value_token Optional, set to the value token index.
+ * @return 1 when a member or element was produced, 0 at the end, or JSONErrorCode on error.
+ */
+int json_iter_next (json_iter_t *it, int *key_token, int *value_token) {
+  if (it->remaining <= 0) return 0;
+  json_token_t *tokens = it->tokens;
+  int key = -1;
+  int value = it->next;
+  if (json_tok_type(&tokens[it->container]) == JSMN_OBJECT) {
+    key = value;
+    value = key + 1;
+  }
+  // strings and primitives have no children to skip
+  int last = value;
+  if ((json_tok_type(&tokens[value]) == JSMN_OBJECT || json_tok_type(&tokens[value]) == JSMN_ARRAY) && json_tok_size(&tokens[value])) {
+    last = json_last_token_index(tokens, value);
+    if (last < 0) return last;
+  }
+  JSON_STATS_ADD(tokens_scanned, value - it->next + 1);
+  it->next = last + 1;
+  it->remaining -= 1;
+  if (key_token) *key_token = key;
+  if (value_token) *value_token = value;
+  return 1;
+}
+
+
+// collect the key indices of an object or the element indices of an array in one allocation
+static int json_root_indicies (json_token_t *tokens, int start_token, int **root_tokens) {
+  json_iter_t it;
+  int err = json_iter_begin(&it, tokens, start_token);
+  if (err != JSON_ERR_NONE) return err;
+  int count = json_tok_size(&tokens[start_token]);
+  if (count == 0) return 0;
+  int *indices = json_realloc(*root_tokens, sizeof(int) * count);
+  if (indices == NULL) {
+    json_free(*root_tokens);
+    *root_tokens = NULL;
+    return JSON_ERR_MEMORY;
+  }
+  *root_tokens = indices;
+  int key, value, found = 0;
+  while (json_iter_next(&it, &key, &value) == 1) {
+    indices[found++] = json_tok_type(&tokens[start_token]) == JSMN_OBJECT ? key : value;
+  }
+  return found;
+}
+
+
+/**
+ * Create an array of token indices that are root keys of the json object at start_token.
+ * NOTE: The caller must free the returned array with json_free.
+ * NOTE: The root_tokens argument should be NULL or there will be undefined behaviour.
+ *
+ * @param tokens The array of json_token_t to parse.
+ * @param start_token The index of the json_token_t object token to parse.
+ * @param root_tokens A pointer to an array of integers to store the root token indices.
+ * @return The number of root tokens found or JSONErrorCode on error.
+*/
+int json_root_object_indicies (json_token_t *tokens, int start_token, int **root_tokens) {
+  // start token must be an object to have root tokens
+  if (json_tok_type(&tokens[start_token]) != JSMN_OBJECT) {
+    return JSON_ERR_INDEX_INVALID;;
+  }
+  return json_root_indicies(tokens, start_token, root_tokens);
+}
+
+
+/**
+ * Create an array of token indicieds taht are root elements of the json array at start_token.
+ * NOTE: The caller is responsible for freeing the returned array with json_free.
+ * NOTE: The root_tokens argument should be initialized to NULL.
+ * @param tokens: The jsmn tokens to search.
+ * @param start_token: The starting token to search from.
+ * @param root_tokens: A pointer to an array of integers to store the root token indices.
+ * @return: The number of root tokens found, or JSONErrorCode if an error occurred.
+*/
+int json_root_array_indicies (json_token_t *tokens, int start_token, int **root_tokens) {
+  // start token must be an object to have root tokens
+  if (json_tok_type(&tokens[start_token]) != JSMN_ARRAY) {
+    return JSON_ERR_INDEX_INVALID;
+  }
+  return json_root_indicies(tokens, start_token, root_tokens);
+}
+
+
+/**
+ * Hash a key name for the per object key hash tables.
+ *
+ * @param key The key characters, not required to be NUL terminated.
+ * @param length The number of characters in the key.
+ * @return The 32 bit FNV-1a hash of the key.
+ */
+uint32_t json_key_hash (const char *key, size_t length) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (unsigned char)key[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+
+// compare a key of known length to a key token
+static bool json_key_equal (const char *key, size_t length, const char *json, json_token_t *tok) {
+  JSON_STATS_ADD(key_compares, 1);
+  return json_tok_type(tok) == JSMN_STRING &&
+    (size_t)(json_tok_end(tok) - json_tok_start(tok)) == length &&
+    memcmp(json + json_tok_start(tok), key, length) == 0;
+}
+
+
+// build the open addressing hash table for the keys of the object at start_token
+// the first element holds the slot mask, each slot holds a key token index or -1
+static int * json_key_hash_build (json_token_t *tokens, int start_token, const char *json) {
+  int key_count = json_tok_size(&tokens[start_token]);
+  int capacity = 1;
+  while (capacity < key_count * 2) capacity <<= 1;
+  int *table = json_malloc(sizeof(int) * (capacity + 1));
+  if (table == NULL) return NULL;
+  table[0] = capacity - 1;
+  int *slots = table + 1;
+  for (int i = 0; i < capacity; i++) slots[i] = -1;
+  int key = start_token + 1;
+  for (int k = 0; k < key_count; k++) {
+    json_token_t *tok = &tokens[key];
+    uint32_t slot = json_key_hash(json + json_tok_start(tok), json_tok_end(tok) - json_tok_start(tok)) & table[0];
+    // duplicate keys keep the first occurrence earlier in the probe sequence
+    while (slots[slot] != -1) slot = (slot + 1) & table[0];
+    slots[slot] = key;
+    key = json_last_token_index(tokens, key) + 1;
+  }
+  return table;
+}
+
+
+// get the key hash table for the object, building it on first use
+static int * json_key_hash_table (json_token_t *tokens, int start_token, const char *json) {
+  json_token_table_t *table = json_active_table;
+  if (table == NULL || table->tokens != tokens || !table->hash_keys) return NULL;
+  if (start_token < 0 || start_token >= table->token_count) return NULL;
+  if (json_tok_size(&tokens[start_token]) < JSON_KEY_HASH_MIN_KEYS) return NULL;
+  if (table->key_hashes == NULL) {
+    table->key_hashes = json_malloc(sizeof(int *) * table->token_count);
+    if (table->key_hashes == NULL) return NULL;
+    memset(table->key_hashes, 0, sizeof(int *) * table->token_count);
+  }
+  if (table->key_hashes[start_token] == NULL) {
+    table->key_hashes[start_token] = json_key_hash_build(tokens, start_token, json);
+  }
+  return table->key_hashes[start_token];
+}
+
+
+// find the token index of a key in the object at start_token without allocating
+static int json_object_key_index (json_token_t *tokens, int start_token, const char *key, size_t length, uint32_t hash, const char *json) {
+  if (json_tok_type(&tokens[start_token]) != JSMN_OBJECT) {
+    return JSON_ERR_KEY_INVALID;
+  }
+  int *table = json_key_hash_table(tokens, start_token, json);
+  if (table != NULL) {
+    int *slots = table + 1;
+    for (uint32_t slot = hash & table[0]; slots[slot] != -1; slot = (slot + 1) & table[0]) {
+      JSON_STATS_ADD(tokens_scanned, 1);
+      if (json_key_equal(key, length, json, &tokens[slots[slot]])) return slots[slot];
+    }
+    return JSON_ERR_KEY_INVALID;
+  }
+  // walk the keys in place, stepping over each value
+  int index = start_token + 1;
+  for (int k = 0; k < json_tok_size(&tokens[start_token]); k++) {
+    JSON_STATS_ADD(tokens_scanned, 1);
+    if (json_key_equal(key, length, json, &tokens[index])) return index;
+    index = json_last_token_index(tokens, index);
+    if (index < 0) return JSON_ERR_KEY_INVALID;
+    index += 1;
+  }
+  return JSON_ERR_KEY_INVALID;
+}
+
+
+/**
+ * Get the token index for the given root key name in the JSON object starting at the given token index.
+ *
+ * @param tokens The array of json_token_t tokens
+ * @param start_token The starting token index
+ * @param key The root key name to search for
+ * @param json The JSON string being parsed
+ * @return The token index for the given root key name or JSONErrorCode if not found
+*/
+int json_root_key_index (json_token_t *tokens, int start_token, char *key, char *json) {
+  JSON_STATS_START(start);
+  size_t length = strlen(key);
+  int index = json_object_key_index(tokens, start_token, key, length, json_key_hash(key, length), json);
+  JSON_STATS_STOP(lookup_cycles, start);
+  JSON_STATS_ADD(lookups, 1);
+  return index;
+}
+
+
+// find the token index of an array element by stepping over the elements before it in place
+static int json_array_element_index (json_token_t *tokens, int start_token, int element) {
+  if (json_tok_type(&tokens[start_token]) != JSMN_ARRAY || element < 0 || element >= json_tok_size(&tokens[start_token])) {
+    return JSON_ERR_INDEX_INVALID;
+  }
+  int index = start_token + 1;
+  for (int k = 0; k < element; k++) {
+    JSON_STATS_ADD(tokens_scanned, 1);
+    index = json_last_token_index(tokens, index);
+    if (index < 0) return JSON_ERR_INDEX_INVALID;
+    index += 1;
+  }
+  return index;
+}
+
+
+typedef struct json_path_part {
+  const char *name;                                          // key name, not NUL terminated
+  size_t length;
+  bool escaped;                                              // the name holds JSON Pointer ~0 and ~1 escapes
+  bool key;                                                  // the part may match an object key
+  int element;                                               // array element index, -1 if the part is only a key
+} json_path_part_t;
+
+
+// parse a decimal array index, JSON Pointer indices have no leading zeros
+static int json_path_element (const char *c, size_t length) {
+  if (length == 0 || length > 10 || (length > 1 && *c == '0')) return -1;
+  int64_t element = 0;
+  for (size_t i = 0; i < length; i++) {
+    if (c[i] < '0' || c[i] > '9') return -1;
+    element = element * 10 + (c[i] - '0');
+  }
+  return element <= INT_MAX ? (int)element : -1;
+}
+
+
+// split the next part from a dot delimited path with [n] subscripts or from a JSON Pointer
+// returns 1 when a part was produced, 0 at the end of the path, or JSONErrorCode
+static int json_path_next (const char *path, size_t length, size_t *position, json_path_part_t *part) {
+  size_t i = *position;
+  if (i >= length) return 0;
+  if (path[0] == '/') {
+    // JSON Pointer, every part is a key or, in an array, an element index
+    const char *slash = memchr(path + i + 1, '/', length - i - 1);
+    size_t end = slash != NULL ? (size_t)(slash - path) : length;
+    part->name = path + i + 1;
+    part->length = end - i - 1;
+    part->escaped = memchr(part->name, '~', part->length) != NULL;
+    part->key = true;
+    part->element = json_path_element(part->name, part->length);
+    *position = end;
+    return 1;
+  }
+  if (path[i] == '[') {
+    // subscript of the previous value
+    const char *close = memchr(path + i, ']', length - i);
+    if (close == NULL) return JSON_ERR_KEY_INVALID;
+    size_t end = close - path;
+    part->name = NULL;
+    part->length = 0;
+    part->escaped = false;
+    part->key = false;
+    part->element = json_path_element(path + i + 1, end - i - 1);
+    if (part->element < 0) return JSON_ERR_KEY_INVALID;
+    end += 1;
+    if (end < length && path[end] != '.' && path[end] != '[') return JSON_ERR_KEY_INVALID;
+    *position = end < length && path[end] == '.' ? end + 1 : end;
+    return 1;
+  }
+  // key name up to the next dot or subscript
+  size_t end = i;
+  while (end < length && path[end] != '.' && path[end] != '[') end++;
+  part->name = path + i;
+  part->length = end - i;
+  part->escaped = false;
+  part->key = true;
+  part->element = -1;
+  *position = end < length && path[end] == '.' ? end + 1 : end;
+  return 1;
+}
+
+
+// decode the ~1 and ~0 escapes of a JSON Pointer key name, returning the decoded length or JSONErrorCode
+static int json_pointer_unescape (const char *name, size_t length, char *buffer, size_t capacity) {
+  size_t out = 0;
+  for (size_t i = 0; i < length; i++) {
+    if (out == capacity) return JSON_ERR_KEY_INVALID;
+    if (name[i] != '~') {
+      buffer[out++] = name[i];
+      continue;
+    }
+    if (i + 1 == length || (name[i + 1] != '0' && name[i + 1] != '1')) return JSON_ERR_KEY_INVALID;
+    buffer[out++] = name[++i] == '0' ? '~' : '/';
+  }
+  return out;
+}
+
+
+// resolve one path part against the value at start_token, key_token is set to the matched key or -1 for an element
+static int json_path_step (json_token_t *tokens, int start_token, const char *name, size_t length, uint32_t hash, int element, bool key, const char *json, int *key_token) {
+  *key_token = -1;
+  if (element >= 0 && (!key || json_tok_type(&tokens[start_token]) == JSMN_ARRAY)) {
+    return json_array_element_index(tokens, start_token, element);
+  }
+  if (!key) return JSON_ERR_KEY_INVALID;
+  int index = json_object_key_index(tokens, start_token, name, length, hash, json);
+  if (index < 0) return index;
+  *key_token = index;
+  return index + 1;
+}
+
+
+// resolve a key path to its value token, key_token is set to the key of the last part or -1 for an element
+static int json_path_value (json_token_t *tokens, int start_token, const char *key, const char *json, int *key_token) {
+  size_t key_length = strlen(key);
+  size_t position = 0;
+  int index = start_token;
+  json_path_part_t part;
+  char decoded[JSON_PATH_MAX_LENGTH];
+  int next;
+  *key_token = -1;
+  // an empty key names the empty key, a key path always has at least one part
+  if (key_length == 0) return json_path_step(tokens, index, key, 0, json_key_hash(key, 0), -1, true, json, key_token);
+  while ((next = json_path_next(key, key_length, &position, &part)) == 1) {
+    const char *name = part.name;
+    size_t length = part.length;
+    if (part.escaped) {
+      int decoded_length = json_pointer_unescape(part.name, part.length, decoded, sizeof(decoded));
+      if (decoded_length < 0) return JSON_ERR_KEY_INVALID;
+      name = decoded;
+      length = decoded_length;
+    }
+    uint32_t hash = part.key ? json_key_hash(name, length) : 0;
+    index = json_path_step(tokens, index, name, length, hash, part.element, part.key, json, key_token);
+    if (index < 0) return JSON_ERR_KEY_INVALID;
+  }
+  return next < 0 ? next : index;
+}
+
+
+/**
+ * Get the index of a key in a JSON object. The key may be the name, a dot delimited name path
+ * with [n] array subscripts such as "items[500].id", or a JSON Pointer such as "/items/500/id".
+ * Array elements are reached by stepping over the elements before them in place, without
+ * allocating.
+ *
+ * @param tokens The array of json_token_t tokens.
+ * @param start_token The index of the starting token.
+ * @param key The key to search for.
+ * @param json The JSON string.
+ * @return The index of the key if found, otherwise JSONErrorCode. A path that ends in an array element has no key, use json_value_index.
+*/
+int json_key_index (json_token_t *tokens, int start_token, char *key, char *json) {
+  JSON_STATS_START(start);
+  JSON_STATS_ADD(lookups, 1);
+  int key_token;
+  int index = json_path_value(tokens, start_token, key, json, &key_token);
+  JSON_STATS_STOP(lookup_cycles, start);
+  return index < 0 || key_token < 0 ? JSON_ERR_KEY_INVALID : key_token;
+}
+
+
+/**
+ * Get the index of the value at a key path. The key uses the same syntax as json_key_index,
+ * a path that ends in an array subscript gives the element token.
+ *
+ * @param tokens The array of json_token_t tokens.
+ * @param start_token The index of the starting token.
+ * @param key The key path to search for.
+ * @param json The JSON string.
+ * @return The index of the value if found, otherwise JSONErrorCode.
+*/
+int json_value_index (json_token_t *tokens, int start_token, char *key, char *json) {
+  JSON_STATS_START(start);
+  JSON_STATS_ADD(lookups, 1);
+  int key_token;
+  int index = json_path_value(tokens, start_token, key, json, &key_token);
+  JSON_STATS_STOP(lookup_cycles, start);
+  return index < 0 ? JSON_ERR_KEY_INVALID : index;
+}
+
+
+// look up a key path with the table attached for the duration of the lookup only
+static int json_table_path_value (json_token_table_t *table, int start_token, char *key, char *json, int *key_token) {
+  json_token_table_t *attached = json_active_table;
+  json_active_table = table;
+  int index = json_path_value(table->tokens, start_token, key, json, key_token);
+  json_active_table = attached;
+  return index;
+}
+
+
+/**
+ * Get the index of a key in a JSON object using the token table built for the tokens. The
+ * table is passed explicitly instead of attached, so it is used for exactly the tokens it was
+ * built from and its cached key hash tables are kept between calls. Read the value with the
+ * json_get_index functions at the returned index + 1.
+ *
+ * @param table The token table built for the parsed tokens.
+ * @param start_token The index of the starting token.
+ * @param key The key to search for, with the syntax of json_key_index.
+ * @param json The JSON string.
+ * @return The index of the key if found, JSON_ERR_INVALID if the table is not built or does not cover start_token, otherwise JSONErrorCode.
+ */
+int json_table_key_index (json_token_table_t *table, int start_token, char *key, char *json) {
+  if (!table || !table->last || start_token < 0 || start_token >= table->token_count) return JSON_ERR_INVALID;
+  JSON_STATS_START(start);
+  JSON_STATS_ADD(lookups, 1);
+  int key_token;
+  int index = json_table_path_value(table, start_token, key, json, &key_token);
+  JSON_STATS_STOP(lookup_cycles, start);
+  return index < 0 || key_token < 0 ? JSON_ERR_KEY_INVALID : key_token;
+}
+
+
+/**
+ * Get the index of the value at a key path using the token table built for the tokens, like
+ * json_value_index.
+ *
+ * @param table The token table built for the parsed tokens.
+ * @param start_token The index of the starting token.
+ * @param key The key path to search for.
+ * @param json The JSON string.
+ * @return The index of the value if found, JSON_ERR_INVALID if the table is not built or does not cover start_token, otherwise JSONErrorCode.
+ */
+int json_table_value_index (json_token_table_t *table, int start_token, char *key, char *json) {
+  if (!table || !table->last || start_token < 0 || start_token >= table->token_count) return JSON_ERR_INVALID;
+  JSON_STATS_START(start);
+  JSON_STATS_ADD(lookups, 1);
+  int key_token;
+  int index = json_table_path_value(table, start_token, key, json, &key_token);
+  JSON_STATS_STOP(lookup_cycles, start);
+  return index < 0 ? JSON_ERR_KEY_INVALID : index;
+}
+
+
+/**
+ * Compile a key path into a reusable query. The path uses the syntax of json_key_index, the
+ * key names are split, decoded, measured and hashed once so lookups with the compiled path
+ * do not allocate or scan the key.
+ *
+ * @param key The key name, dot delimited name path with [n] subscripts, or JSON Pointer.
+ * @param path The compiled path to initialize.
+ * @return JSON_ERR_NONE on success, JSON_ERR_KEY_INVALID if the key is empty, malformed or exceeds JSON_PATH_MAX_SEGMENTS or JSON_PATH_MAX_LENGTH.
+ */
+int json_path_compile (const char *key, json_path_t *path) {
+  if (!key || !path) return JSON_ERR_KEY_INVALID;
+  size_t key_length = strlen(key);
+  path->segment_count = 0;
+  if (key_length == 0 || key_length >= JSON_PATH_MAX_LENGTH) return JSON_ERR_KEY_INVALID;
+  size_t position = 0;
+  size_t names_length = 0;
+  json_path_part_t part;
+  int next;
+  while ((next = json_path_next(key, key_length, &position, &part)) == 1) {
+    if (path->segment_count == JSON_PATH_MAX_SEGMENTS) {
+      path->segment_count = 0;
+      return JSON_ERR_KEY_INVALID;
+    }
+    // the decoded names are never longer than the key
+    int length = part.length;
+    if (part.escaped) {
+      length = json_pointer_unescape(part.name, part.length, path->names + names_length, JSON_PATH_MAX_LENGTH - names_length);
+      if (length < 0) {
+        path->segment_count = 0;
+        return JSON_ERR_KEY_INVALID;
       }
-      is_key = true; // next token will be a key
     }
+    else if (length > 0) {
+      memcpy(path->names + names_length, part.name, length);
+    }
+    json_path_segment_t *segment = &path->segments[path->segment_count++];
+    segment->offset = names_length;
+    segment->length = length;
+    segment->hash = json_key_hash(path->names + names_length, length);
+    segment->element = part.element;
+    segment->key = part.key;
+    names_length += length;
   }
-  return start_token;
+  if (next < 0) path->segment_count = 0;
+  return next < 0 ? next : JSON_ERR_NONE;
+}
+
+
+// resolve a compiled path to its value token, key_token is set to the key of the last segment or -1 for an element
+static int json_path_resolve (const json_path_t *path, const char *json, json_token_t *tokens, int start_token, int *key_token) {
+  JSON_STATS_START(start);
+  JSON_STATS_ADD(lookups, 1);
+  int index = start_token;
+  *key_token = -1;
+  for (int i = 0; i < path->segment_count && index >= 0; i++) {
+    const json_path_segment_t *segment = &path->segments[i];
+    index = json_path_step(tokens, index, path->names + segment->offset, segment->length, segment->hash, segment->element, segment->key, json, key_token);
+  }
+  JSON_STATS_STOP(lookup_cycles, start);
+  if (index < 0 || path->segment_count == 0) return JSON_ERR_KEY_INVALID;
+  return index;
 }
 
 
 /**
- * Find the last token index in an array and return the index of the last token in the array or -1 on error.
- * @param tokens The jsmntok_t array of tokens.
- * @param start_token The index of the array token.
- * @return The index of the last token in the array or JSONErrorCode on error.
-*/
-int json_last_array_token_index (jsmntok_t *tokens, int start_token) {
-  // start token must be an array
-  if (tokens[start_token].type != JSMN_ARRAY) {
-    return JSON_ERR_INDEX_INVALID;
+ * Get the index of the last key in a compiled path.
+ *
+ * @param path The compiled path.
+ * @param json The JSON string.
+ * @param tokens The array of json_token_t tokens.
+ * @param start_token The index of the object token to start from.
+ * @return The index of the key if found, otherwise JSONErrorCode. A path that ends in an array element has no key, use json_path_value_index.
+ */
+int json_path_lookup (const json_path_t *path, const char *json, json_token_t *tokens, int start_token) {
+  int key_token;
+  int index = json_path_resolve(path, json, tokens, start_token, &key_token);
+  return index < 0 || key_token < 0 ? JSON_ERR_KEY_INVALID : key_token;
+}
+
+
+/**
+ * Get the index of the value at a compiled path.
+ *
+ * @param path The compiled path.
+ * @param json The JSON string.
+ * @param tokens The array of json_token_t tokens.
+ * @param start_token The index of the token to start from.
+ * @return The index of the value if found, otherwise JSONErrorCode.
+ */
+int json_path_value_index (const json_path_t *path, const char *json, json_token_t *tokens, int start_token) {
+  int key_token;
+  return json_path_resolve(path, json, tokens, start_token, &key_token);
+}
+
+
+// get the value of a matched field from the value token
+static int json_field_value (json_field_t *field, int index, const char *json, json_token_t *tokens) {
+  switch (field->type) {
+    case JSON_FIELD_STRING:
+      return json_get_index_s(index, (char **)field->value, json, tokens);
+    case JSON_FIELD_VIEW:
+      return json_get_index_sv(index, (json_string_view_t *)field->value, json, tokens);
+    case JSON_FIELD_INT:
+      return json_get_index_i(index, (int *)field->value, json, tokens);
+    case JSON_FIELD_DOUBLE:
+      return json_get_index_d(index, (double *)field->value, json, tokens);
+    case JSON_FIELD_BOOL:
+      return json_get_index_b(index, (bool *)field->value, json, tokens);
+    case JSON_FIELD_INDEX:
+      *(int *)field->value = index;
+      return JSON_ERR_NONE;
+    default:
+      return JSON_ERR_INVALID;
   }
-  // the number of root tokens in this array is the token child size
-  int token_count = tokens[start_token].size;
-  // loop through all the tokens in the array
-  while (token_count > 0) {
-    start_token += 1;
-    // if token has size then this array value is an array or an object
-    if (tokens[start_token].size) {
-      if (tokens[start_token].type == JSMN_ARRAY) {
-        start_token = json_last_array_token_index(tokens, start_token);
-        if (start_token < 0) return start_token;
-      }
-      else if (tokens[start_token].type == JSMN_OBJECT) {
-        start_token = json_last_object_token_index(tokens, start_token);
-        if (start_token < 0) return start_token;
+}
+
+
+// match the pending fields in mask against the keys of the object, descending only into matched keys
+static void json_fields_walk (json_field_t *fields, uint64_t mask, uint16_t *offset, uint16_t *length, const char *json, json_token_t *tokens, int start_token) {
+  if (json_tok_type(&tokens[start_token]) != JSMN_OBJECT) return;
+  int key = start_token + 1;
+  for (int k = 0; k < json_tok_size(&tokens[start_token]) && mask != 0; k++) {
+    uint64_t matched = 0;
+    for (int f = 0; f < JSON_FIELDS_MAX; f++) {
+      if (!(mask & ((uint64_t)1 << f))) continue;
+      if (json_key_equal(fields[f].key + offset[f], length[f], json, &tokens[key])) matched |= (uint64_t)1 << f;
+    }
+    if (matched) {
+      // a field only matches the first key with its name
+      mask &= ~matched;
+      uint64_t deeper = 0;
+      for (int f = 0; f < JSON_FIELDS_MAX; f++) {
+        if (!(matched & ((uint64_t)1 << f))) continue;
+        if (json_tok_size(&tokens[key]) != 1) continue;
+        const char *next = fields[f].key + offset[f] + length[f];
+        if (*next == '\0') {
+          fields[f].status = json_field_value(&fields[f], key + 1, json, tokens);
+          fields[f].found = fields[f].status == JSON_ERR_NONE;
+        }
+        else {
+          // advance to the next key name in the path
+          offset[f] += length[f] + 1;
+          const char *dot = strchr(next + 1, '.');
+          length[f] = dot != NULL ? (uint16_t)(dot - (next + 1)) : (uint16_t)strlen(next + 1);
+          deeper |= (uint64_t)1 << f;
+        }
       }
-      else {
-        return JSON_ERR_INVALID;
+      if (deeper) json_fields_walk(fields, deeper, offset, length, json, tokens, key + 1);
+    }
+    key = json_last_token_index(tokens, key);
+    if (key < 0) return;
+    key += 1;
+  }
+}
+
+
+// microsecond clock for batch throughput and field extraction time
+static uint64_t json_time_us (void) {
+#if defined(LIB_PICO_STDLIB)
+  return time_us_64();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+#endif
+}
+
+
+/**
+ * Get the values of many fields in a single traversal of the tokens. Each field names a dot
+ * delimited key path, the value type and the destination, all fields are matched in one depth
+ * first pass that only descends into objects on a requested path. Array subscripts and JSON
+ * Pointers are not supported, a field using them gets the status JSON_ERR_INVALID.
+ * NOTE: The caller is responsible for freeing JSON_FIELD_STRING values with json_free.
+ *
+ * @param fields The fields to get, found and status are set for each field.
+ * @param field_count The number of fields.
+ * @param json The JSON string.
+ * @param tokens The parsed JSON tokens.
+ * @param start_token The index of the object token to start from.
+ * @param elapsed_us Set to the microseconds spent getting all fields, may be NULL.
+ * @return The number of fields found, or JSONErrorCode on failure.
+ */
+int json_get_fields (json_field_t *fields, int field_count, const char *json, json_token_t *tokens, int start_token, uint64_t *elapsed_us) {
+  if (!fields || field_count < 0 || !json || !tokens) return JSON_ERR_INVALID;
+  uint64_t started = elapsed_us != NULL ? json_time_us() : 0;
+  int found = 0;
+  // fields are matched in groups that fit the traversal mask
+  for (int group = 0; group < field_count; group += JSON_FIELDS_MAX) {
+    json_field_t *batch = fields + group;
+    int batch_count = field_count - group < JSON_FIELDS_MAX ? field_count - group : JSON_FIELDS_MAX;
+    uint16_t offset[JSON_FIELDS_MAX];
+    uint16_t length[JSON_FIELDS_MAX];
+    uint64_t mask = 0;
+    for (int f = 0; f < batch_count; f++) {
+      batch[f].found = false;
+      batch[f].status = JSON_ERR_KEY_INVALID;
+      if (batch[f].key == NULL || batch[f].value == NULL) continue;
+      if (batch[f].key[0] == '/' || strchr(batch[f].key, '[') != NULL) {
+        batch[f].status = JSON_ERR_INVALID;
+        continue;
       }
+      const char *dot = strchr(batch[f].key, '.');
+      offset[f] = 0;
+      length[f] = dot != NULL ? (uint16_t)(dot - batch[f].key) : (uint16_t)strlen(batch[f].key);
+      mask |= (uint64_t)1 << f;
+    }
+    json_fields_walk(batch, mask, offset, length, json, tokens, start_token);
+    for (int f = 0; f < batch_count; f++) {
+      if (batch[f].found) found += 1;
     }
-    token_count -= 1;
   }
-  return start_token;
+  if (elapsed_us != NULL) *elapsed_us = json_time_us() - started;
+  return found;
 }
 
 
 /**
- * Create an array of token indices that are root keys of the json object at start_token.
- * NOTE: The caller must free the returned array.
- * NOTE: The root_tokens argument should be NULL or there will be undefined behaviour.
+ * Initialize a shape cache for a set of compiled paths. The cache records the key token
+ * indices resolved on the first document so later documents with the same structure only
+ * need to verify the cached keys.
  *
- * @param tokens The array of jsmntok_t to parse.
- * @param start_token The index of the jsmntok_t object token to parse.
- * @param root_tokens A pointer to an array of integers to store the root token indices.
- * @return The number of root tokens found or JSONErrorCode on error.
-*/
-int json_root_object_indicies (jsmntok_t *tokens, int start_token, int **root_tokens) {
-  // start token must be an object to have root tokens
-  if (tokens[start_token].type != JSMN_OBJECT) {
-    return JSON_ERR_INDEX_INVALID;;
+ * @param cache The shape cache to initialize.
+ * @param paths The compiled paths, the paths must remain valid while the cache is used.
+ * @param path_count The number of paths, at most JSON_SHAPE_CACHE_MAX_PATHS.
+ * @return JSON_ERR_NONE on success, JSONErrorCode on failure.
+ */
+int json_shape_cache_init (json_shape_cache_t *cache, const json_path_t *paths, int path_count) {
+  if (!cache || !paths || path_count < 0 || path_count > JSON_SHAPE_CACHE_MAX_PATHS) return JSON_ERR_INVALID;
+  cache->path_count = path_count;
+  cache->hits = 0;
+  cache->misses = 0;
+  for (int i = 0; i < path_count; i++) {
+    cache->entries[i].path = &paths[i];
+    cache->entries[i].steps[0].index = -1; // not resolved yet
   }
-  // the number of root tokens in this object is the token child size
-  int token_count = tokens[start_token].size;
-  int key_count = 0;
-  bool is_key = true;
-  // process each root token in the object
-  while (token_count > key_count) {
-    start_token += 1;
-    if (is_key) {
-      key_count += 1;
-      // allocate memory for the key index array
-      int *tmp = *root_tokens;
-      if (*root_tokens == NULL) {
-        // allocate memory for the key index array
-        *root_tokens = malloc(sizeof(int) * key_count);
-      }
-      else {
-        // reallocate with more memory for more keys
-        *root_tokens = realloc(*root_tokens, sizeof(int) * key_count);
-      }
-      // check if memory allocation was successful
-      if (NULL == *root_tokens) {
-        if (tmp != NULL) free(tmp);
-        return JSON_ERR_MEMORY;
-      }
-      // store the index of this root token in the array
-      (*root_tokens)[key_count - 1] = start_token;
-      is_key = false;
+  return JSON_ERR_NONE;
+}
+
+
+// a segment selects an array element for a [n] subscript, or for a JSON Pointer index when the value is an array
+static bool json_shape_segment_element (const json_path_segment_t *segment, json_token_t *tokens, int parent) {
+  return segment->element >= 0 && (!segment->key || json_tok_type(&tokens[parent]) == JSMN_ARRAY);
+}
+
+
+// record where a segment resolved, the token and the object or array containing it
+static void json_shape_step_set (json_shape_step_t *step, json_token_t *tokens, int parent, int index) {
+  step->index = index;
+  step->parent_size = json_tok_size(&tokens[parent]);
+  step->parent_start = json_tok_start(&tokens[parent]);
+  step->parent_end = json_tok_end(&tokens[parent]);
+  step->start = json_tok_start(&tokens[index]);
+  step->end = json_tok_end(&tokens[index]);
+}
+
+
+// check that each cached segment token is still at the same offsets, in a container with the
+// same offsets and child count, and that keys still hold the path names, a few compares per
+// segment instead of a walk. element is set if the last segment is an element
+static bool json_shape_entry_valid (const json_shape_entry_t *entry, const char *json, json_token_t *tokens, int token_count, bool *element) {
+  const json_path_t *path = entry->path;
+  int parent = 0;
+  for (int i = 0; i < path->segment_count; i++) {
+    const json_shape_step_t *step = &entry->steps[i];
+    int index = step->index;
+    if (index <= parent || index >= token_count) return false;
+    json_token_t *owner = &tokens[parent];
+    json_token_t *tok = &tokens[index];
+    if (json_tok_start(owner) != step->parent_start || json_tok_end(owner) != step->parent_end ||
+        json_tok_size(owner) != step->parent_size || json_tok_start(tok) != step->start || json_tok_end(tok) != step->end) {
+      return false;
     }
-    else {
-      // skip over all values under this key
-      if (tokens[start_token].type == JSMN_ARRAY) {
-        // get the last token in the array
-        start_token = json_last_array_token_index(tokens, start_token);
-      }
-      else if (tokens[start_token].type == JSMN_OBJECT) {
-        // get last token in the object
-        start_token = json_last_object_token_index(tokens, start_token);
-      }
-      is_key = true; // next token will be a key
+    const json_path_segment_t *segment = &path->segments[i];
+    *element = json_shape_segment_element(segment, tokens, parent);
+    if (*element) {
+      if (json_tok_type(owner) != JSMN_ARRAY) return false;
+      parent = index;
+      continue;
+    }
+    if (json_tok_type(owner) != JSMN_OBJECT || json_tok_size(tok) != 1 ||
+        !json_key_equal(path->names + segment->offset, segment->length, json, tok)) {
+      return false;
+    }
+    parent = index + 1;
+  }
+  return true;
+}
+
+
+/**
+ * Get the key token index of a cached path. Each cached segment is verified in constant time
+ * against the key name, the token offsets and the offsets and child count of the object or
+ * array holding it, so a hit does not walk the document. If the document shape differs the
+ * path is looked up again and the cache refreshed. Paths are resolved from the root token.
+ *
+ * @param cache The shape cache.
+ * @param path_index The index of the path in the paths given to json_shape_cache_init.
+ * @param json The JSON string.
+ * @param tokens The parsed JSON tokens.
+ * @param token_count The number of parsed tokens.
+ * @return The index of the key if found, otherwise JSONErrorCode. A path that ends in an array element has no key.
+ */
+int json_shape_key_index (json_shape_cache_t *cache, int path_index, const char *json, json_token_t *tokens, int token_count) {
+  if (path_index < 0 || path_index >= cache->path_count || token_count <= 0) return JSON_ERR_KEY_INVALID;
+  json_shape_entry_t *entry = &cache->entries[path_index];
+  const json_path_t *path = entry->path;
+  if (path->segment_count == 0) return JSON_ERR_KEY_INVALID;
+  bool element = false;
+  if (entry->steps[0].index >= 0 && json_shape_entry_valid(entry, json, tokens, token_count, &element)) {
+    cache->hits += 1;
+    return element ? JSON_ERR_KEY_INVALID : entry->steps[path->segment_count - 1].index;
+  }
+  // full lookup recording the key index, or element index, of every segment
+  cache->misses += 1;
+  entry->steps[0].index = -1;
+  int index = 0;
+  int key_token = -1;
+  for (int i = 0; i < path->segment_count; i++) {
+    const json_path_segment_t *segment = &path->segments[i];
+    int parent = index;
+    index = json_path_step(tokens, index, path->names + segment->offset, segment->length, segment->hash, segment->element, segment->key, json, &key_token);
+    if (index < 0) {
+      entry->steps[0].index = -1;
+      return JSON_ERR_KEY_INVALID;
     }
+    json_shape_step_set(&entry->steps[i], tokens, parent, key_token >= 0 ? key_token : index);
   }
+  return key_token >= 0 ? key_token : JSON_ERR_KEY_INVALID;
+}
+
+
+// skip JSON whitespace
+static const char * json_scan_space (const char *c, const char *end) {
+  while (c < end && (*c == ' ' || *c == '\t' || *c == '\n' || *c == '\r')) c++;
+  return c;
+}
 
-  return key_count;
+
+// find the closing quote of a string, c is the character after the opening quote
+static const char * json_scan_string_end (const char *c, const char *end) {
+  while (c < end) {
+    const char *quote = memchr(c, '"', end - c);
+    if (quote == NULL) return NULL;
+    // the quote is escaped when preceded by an odd number of backslashes
+    const char *b = quote;
+    while (b > c && b[-1] == '\\') b--;
+    if (((quote - b) & 1) == 0) return quote;
+    c = quote + 1;
+  }
+  return NULL;
 }
 
 
 /**
- * Create an array of token indicieds taht are root elements of the json array at start_token.
- * NOTE: The caller is responsible for freeing the returned array.
- * NOTE: The root_tokens argument should be initialized to NULL.
- * @param tokens: The jsmn tokens to search.
- * @param start_token: The starting token to search from.
- * @param root_tokens: A pointer to an array of integers to store the root token indices.
- * @return: The number of root tokens found, or JSONErrorCode if an error occurred.
-*/
-int json_root_array_indicies (jsmntok_t *tokens, int start_token, int **root_tokens) {
-  // start token must be an object to have root tokens
-  if (tokens[start_token].type != JSMN_ARRAY) {
-    return JSON_ERR_INDEX_INVALID;
+ * Skip one JSON value by quote and bracket matching without creating tokens.
+ *
+ * @param c The first character of the value.
+ * @param end The end of the JSON text.
+ * @return The character after the value, or NULL if the value is not terminated.
+ */
+static const char * json_skip_value (const char *c, const char *end) {
+  if (c >= end) return NULL;
+  if (*c == '"') {
+    const char *quote = json_scan_string_end(c + 1, end);
+    return quote != NULL ? quote + 1 : NULL;
   }
-  // the number of root tokens in this array is the token child size
-  int token_count = tokens[start_token].size;
-  int key_count = 0;
-  // process each root token in the array
-  while (token_count > key_count) {
-    start_token += 1;
-    key_count += 1;
-    // allocate memory for the key index array
-    int *tmp = *root_tokens;
-    if (*root_tokens == NULL) {
-      // allocate memory for the key index array
-      *root_tokens = malloc(sizeof(int) * key_count);
+  if (*c != '{' && *c != '[') {
+    // primitives end at a delimiter or the end of the text
+    while (c < end && *c != ',' && *c != '}' && *c != ']' && *c != ':' &&
+      *c != ' ' && *c != '\t' && *c != '\n' && *c != '\r') c++;
+    return c;
+  }
+  int depth = 0;
+  while (c < end) {
+    switch (*c) {
+      case '"':
+        c = json_scan_string_end(c + 1, end);
+        if (c == NULL) return NULL;
+        break;
+      case '{':
+      case '[':
+        depth += 1;
+        break;
+      case '}':
+      case ']':
+        if (--depth == 0) return c + 1;
+        break;
+      default:
+        break;
+    }
+    c++;
+  }
+  return NULL;
+}
+
+
+/**
+ * Find a value directly in the JSON text without tokenizing the document. Only the objects
+ * on the key path are descended into, sibling values are skipped by quote and bracket
+ * matching, and scanning stops at the value. The text is not validated beyond what is
+ * needed to find the value.
+ *
+ * @param json The JSON text, it does not need to be NUL terminated.
+ * @param length The length of the JSON text.
+ * @param key The key name or dot delimited name path.
+ * @param value The view set to the value text, strings exclude the quotes and are not unescaped.
+ * @return The jsmntype_t of the value on success, otherwise JSONErrorCode.
+ */
+int json_scan_value (const char *json, size_t length, const char *key, json_string_view_t *value) {
+  if (!json || !key || !value) return JSON_ERR_INVALID;
+  const char *end = json + length;
+  const char *c = json_scan_space(json, end);
+  size_t key_length = strlen(key);
+  if (key_length == 0) return JSON_ERR_KEY_INVALID;
+  size_t dot_index = 0;
+  while (dot_index < key_length) {
+    const char *key_dot = key + dot_index;
+    const char *dot = memchr(key_dot, '.', key_length - dot_index);
+    size_t key_dot_length = dot != NULL ? (size_t)(dot - key_dot) : key_length - dot_index;
+    dot_index += key_dot_length + 1;
+    if (c >= end) return JSON_ERR_INVALID;
+    if (*c != '{') return JSON_ERR_KEY_INVALID;
+    c = json_scan_space(c + 1, end);
+    // walk the members of the object until the key name matches
+    while (true) {
+      if (c >= end) return JSON_ERR_INVALID;
+      if (*c == '}') return JSON_ERR_KEY_INVALID;
+      if (*c != '"') return JSON_ERR_INVALID;
+      const char *name = c + 1;
+      const char *quote = json_scan_string_end(name, end);
+      if (quote == NULL) return JSON_ERR_INVALID;
+      c = json_scan_space(quote + 1, end);
+      if (c >= end || *c != ':') return JSON_ERR_INVALID;
+      c = json_scan_space(c + 1, end);
+      if ((size_t)(quote - name) == key_dot_length && memcmp(name, key_dot, key_dot_length) == 0) break;
+      c = json_skip_value(c, end);
+      if (c == NULL) return JSON_ERR_INVALID;
+      c = json_scan_space(c, end);
+      if (c >= end) return JSON_ERR_INVALID;
+      if (*c == '}') return JSON_ERR_KEY_INVALID;
+      if (*c != ',') return JSON_ERR_INVALID;
+      c = json_scan_space(c + 1, end);
+    }
+  }
+  const char *value_end = json_skip_value(c, end);
+  if (value_end == NULL || value_end == c) return JSON_ERR_INVALID;
+  switch (*c) {
+    case '"':
+      value->ptr = c + 1;
+      value->len = value_end - c - 2;
+      return JSMN_STRING;
+    case '{':
+    case '[':
+      value->ptr = c;
+      value->len = value_end - c;
+      return *c == '{' ? JSMN_OBJECT : JSMN_ARRAY;
+    default:
+      value->ptr = c;
+      value->len = value_end - c;
+      return JSMN_PRIMITIVE;
+  }
+}
+
+
+// tokens emitted by a selective parse
+typedef struct json_select {
+  const json_path_t *paths;
+  const char *json;
+  const char *end;
+  jsmntok_t *tokens;
+  unsigned int count;
+  unsigned int capacity;
+} json_select_t;
+
+
+// append a token, growing the token buffer geometrically
+static int json_select_emit (json_select_t *select, jsmntype_t type, const char *start, const char *end, int size) {
+  if (select->count == select->capacity) {
+    unsigned int grown = select->capacity ? select->capacity * 2 : JSON_MIN_TOKEN_CAPACITY;
+    jsmntok_t *tmp = json_realloc(select->tokens, sizeof(jsmntok_t) * grown);
+    if (tmp == NULL) return JSON_ERR_MEMORY;
+    select->tokens = tmp;
+    select->capacity = grown;
+  }
+  jsmntok_t *tok = &select->tokens[select->count];
+  tok->type = type;
+  tok->start = start - select->json;
+  tok->end = end - select->json;
+  tok->size = size;
+  return select->count++;
+}
+
+
+// tokenize a selected value completely with jsmn, appending the tokens with document offsets
+static int json_select_subtree (json_select_t *select, const char *c, const char *value_end) {
+  jsmn_parser parser;
+  jsmn_init(&parser);
+  unsigned int first = select->count;
+  while (true) {
+    int token_count = jsmn_parse(&parser, c, value_end - c, select->tokens + first, select->capacity - first);
+    if (token_count > 0) {
+      select->count = first + token_count;
+      break;
+    }
+    if (token_count != JSMN_ERROR_NOMEM) return JSON_ERR_INVALID;
+    // grow and resume parsing where jsmn stopped
+    unsigned int grown = select->capacity ? select->capacity * 2 : JSON_MIN_TOKEN_CAPACITY;
+    jsmntok_t *tmp = json_realloc(select->tokens, sizeof(jsmntok_t) * grown);
+    if (tmp == NULL) return JSON_ERR_MEMORY;
+    select->tokens = tmp;
+    select->capacity = grown;
+  }
+  int offset = c - select->json;
+  for (unsigned int i = first; i < select->count; i++) {
+    select->tokens[i].start += offset;
+    select->tokens[i].end += offset;
+  }
+  return JSON_ERR_NONE;
+}
+
+
+// emit the value at c for the paths in mask that have matched depth segments, skipping unselected values
+// returns the character after the value, or NULL with *err set on failure
+static const char * json_select_value (json_select_t *select, const char *c, uint64_t mask, int depth, int *err) {
+  const char *end = select->end;
+  bool complete = *c != '{' && *c != '[';
+  for (uint64_t m = mask; m != 0 && !complete; m &= m - 1) {
+    if (select->paths[__builtin_ctzll(m)].segment_count == depth) complete = true;
+  }
+  if (complete) {
+    // a value at the end of a path is tokenized completely, a scalar where a path continues is a single token
+    const char *value_end = json_skip_value(c, end);
+    *err = value_end != NULL && value_end > c ? json_select_subtree(select, c, value_end) : JSON_ERR_INVALID;
+    return *err == JSON_ERR_NONE ? value_end : NULL;
+  }
+  bool object = *c == '{';
+  char close = object ? '}' : ']';
+  int container = json_select_emit(select, object ? JSMN_OBJECT : JSMN_ARRAY, c, c, 0);
+  if (container < 0) {
+    *err = container;
+    return NULL;
+  }
+  // elements before the last selected element are kept as stub tokens so indices still hold
+  int last_element = -1;
+  for (uint64_t m = object ? 0 : mask; m != 0; m &= m - 1) {
+    const json_path_segment_t *segment = &select->paths[__builtin_ctzll(m)].segments[depth];
+    if (segment->element > last_element) last_element = segment->element;
+  }
+  *err = JSON_ERR_INVALID;
+  int size = 0;
+  c = json_scan_space(c + 1, end);
+  for (int element = 0; c < end && *c != close; element++) {
+    uint64_t matched = 0;
+    if (object) {
+      if (*c != '"') return NULL;
+      const char *name = c + 1;
+      const char *quote = json_scan_string_end(name, end);
+      if (quote == NULL) return NULL;
+      for (uint64_t m = mask; m != 0; m &= m - 1) {
+        int p = __builtin_ctzll(m);
+        const json_path_segment_t *segment = &select->paths[p].segments[depth];
+        JSON_STATS_ADD(key_compares, 1);
+        if (segment->key && (size_t)(quote - name) == segment->length &&
+          memcmp(name, select->paths[p].names + segment->offset, segment->length) == 0) matched |= (uint64_t)1 << p;
+      }
+      c = json_scan_space(quote + 1, end);
+      if (c >= end || *c != ':') return NULL;
+      c = json_scan_space(c + 1, end);
+      if (matched) {
+        // only keys on a path are kept, with their values
+        int key = json_select_emit(select, JSMN_STRING, name, quote, 1);
+        if (key < 0) {
+          *err = key;
+          return NULL;
+        }
+        size += 1;
+      }
     }
     else {
-      // reallocate with more memory for more keys
-      *root_tokens = realloc(*root_tokens, sizeof(int) * key_count);
-    }
-    // store the index of this root token in the array
-    (*root_tokens)[key_count - 1] = start_token;
-    // if token has size then skip over all tokens in this token object/array
-    if (tokens[start_token].size) {
-      // skip over all values under this key
-      if (tokens[start_token].type == JSMN_ARRAY) {
-        // get the last token in the array
-        start_token = json_last_array_token_index(tokens, start_token);
+      for (uint64_t m = mask; m != 0; m &= m - 1) {
+        int p = __builtin_ctzll(m);
+        if (select->paths[p].segments[depth].element == element) matched |= (uint64_t)1 << p;
       }
-      else if (tokens[start_token].type == JSMN_OBJECT) {
-        // get last token in the object
-        start_token = json_last_object_token_index(tokens, start_token);
+      if (element <= last_element) size += 1;
+    }
+    const char *next;
+    if (matched) {
+      next = json_select_value(select, c, matched, depth + 1, err);
+      if (next == NULL) return NULL;
+    }
+    else {
+      next = json_skip_value(c, end);
+      if (next == NULL || next == c) return NULL;
+      if (!object && element < last_element) {
+        jsmntype_t type = *c == '{' ? JSMN_OBJECT : *c == '[' ? JSMN_ARRAY : *c == '"' ? JSMN_STRING : JSMN_PRIMITIVE;
+        int stub = type == JSMN_STRING ? json_select_emit(select, type, c + 1, next - 1, 0) : json_select_emit(select, type, c, next, 0);
+        if (stub < 0) {
+          *err = stub;
+          return NULL;
+        }
       }
     }
+    c = json_scan_space(next, end);
+    if (c < end && *c == ',') c = json_scan_space(c + 1, end);
   }
-
-  return key_count;
+  if (c >= end) return NULL;
+  *err = JSON_ERR_NONE;
+  select->tokens[container].size = size;
+  select->tokens[container].end = c + 1 - select->json;
+  return c + 1;
 }
 
 
 /**
- * Get the token index for the given root key name in the JSON object starting at the given token index.
+ * Tokenize only the values at a set of compiled paths and the containers leading to them.
+ * Values off the paths are skipped by quote and bracket matching without creating tokens,
+ * so the token count and memory scale with the selected values rather than the document.
+ * Objects on a path keep only the keys on a path, arrays keep a stub token with no children
+ * for each element before the last selected element so subscripts still select the right
+ * element. The tokens work with the json_get methods from the root token, values that were
+ * not selected are not found. The skipped text is not validated.
+ * NOTE: The caller is responsible for freeing the allocated memory for the tokens array with json_free.
  *
- * @param tokens The array of jsmntok_t tokens
- * @param start_token The starting token index
- * @param key The root key name to search for
- * @param json The JSON string being parsed
- * @return The token index for the given root key name or JSONErrorCode if not found
-*/
-int json_root_key_index (jsmntok_t *tokens, int start_token, char *key, char *json) {
-  // get root key indicies to search
-  int *indicies = NULL;
-  int key_count = json_root_object_indicies(tokens, start_token, &indicies);
-  if (key_count <= 0) {
-    if (indicies != NULL) free(indicies);
-    return JSON_ERR_KEY_INVALID;
+ * @param paths The compiled paths to select, resolved from the root value.
+ * @param path_count The number of paths, at most 64.
+ * @param json The JSON text, it does not need to be NUL terminated.
+ * @param length The length of the JSON text.
+ * @param tokens A pointer that will be set to the allocated token array.
+ * @return The number of tokens allocated into the tokens pointer, or JSONErrorCode on failure.
+ */
+int json_parse_tokens_selected (const json_path_t *paths, int path_count, const char *json, size_t length, json_token_t **tokens) {
+  if (!paths || path_count <= 0 || path_count > 64 || !json || !tokens) return JSON_ERR_INVALID;
+  *tokens = NULL;
+  if (length > JSON_TOKEN_OFFSET_MAX) return JSON_ERR_RANGE;
+  for (int p = 0; p < path_count; p++) {
+    if (paths[p].segment_count <= 0) return JSON_ERR_KEY_INVALID;
   }
-  for (int i = 0; i < key_count; i++) {
-    if (json_key_strcmp(key, json, &tokens[indicies[i]]) == JSON_KEY_MATCH) {
-      int result = indicies[i];
-      free(indicies);
-      return result;
+  JSON_STATS_START(start);
+  json_select_t select = { paths, json, json + length, NULL, 0, 0 };
+  const char *c = json_scan_space(json, select.end);
+  uint64_t mask = path_count == 64 ? ~(uint64_t)0 : ((uint64_t)1 << path_count) - 1;
+  int err = JSON_ERR_NONE;
+  if (c >= select.end || json_select_value(&select, c, mask, 0, &err) == NULL) {
+    json_free(select.tokens);
+    return err != JSON_ERR_NONE ? err : JSON_ERR_INVALID;
+  }
+  JSON_STATS_STOP(parse_cycles, start);
+  JSON_STATS_ADD(parses, 1);
+  return json_tokens_keep(select.tokens, select.count, tokens);
+}
+
+
+/**
+ * Parse a buffer of newline delimited or concatenated JSON documents, passing each record
+ * and its tokens to the callback. Record boundaries are found by quote and bracket matching,
+ * one parser and one token buffer are reused for every record so there is a single jsmn pass
+ * and no allocation per record once the token buffer has grown to the largest record.
+ * A record that fails to parse is counted in the stats and parsing resumes on the next line.
+ * NOTE: The tokens passed to the callback are only valid until the callback returns.
+ *
+ * @param json The buffer of JSON records, it does not need to be NUL terminated.
+ * @param length The length of the buffer.
+ * @param callback Called with each record, its tokens and the context, a non zero return stops the batch.
+ * @param context Passed to the callback.
+ * @param stats Optional, set to the record, error and byte counts and the throughput of the batch.
+ * @return The number of records passed to the callback, or JSONErrorCode on failure.
+ */
+int json_parse_batch (const char *json, size_t length, json_record_fn callback, void *context, json_batch_stats_t *stats) {
+  if (!json || !callback) return JSON_ERR_INVALID;
+  uint64_t started = json_time_us();
+  const char *end = json + length;
+  const char *c = json;
+  jsmn_parser parser;
+  jsmntok_t *tokens = NULL;
+  unsigned int capacity = JSON_MIN_TOKEN_CAPACITY;
+  int records = 0;
+  int errors = 0;
+  int result = JSON_ERR_NONE;
+  while ((c = json_scan_space(c, end)) < end) {
+    const char *record_end = json_skip_value(c, end);
+    int token_count = JSON_ERR_INVALID;
+    if (record_end != NULL && record_end > c) {
+      jsmn_init(&parser);
+      token_count = json_parse_tokens_grow(&parser, c, record_end - c, &tokens, &capacity);
+    }
+    if (token_count == JSON_ERR_MEMORY) {
+      result = JSON_ERR_MEMORY;
+      break;
     }
+    if (token_count <= 0) {
+      // resynchronize on the next line
+      errors += 1;
+      const char *newline = memchr(c, '\n', end - c);
+      c = newline != NULL ? newline + 1 : end;
+      continue;
+    }
+    json_token_t *compact;
+    if (json_tokens_compact(tokens, token_count, &compact) != JSON_ERR_NONE) {
+      errors += 1;
+      c = record_end;
+      continue;
+    }
+    records += 1;
+    int stop = callback(c, record_end - c, compact, token_count, context);
+    c = record_end;
+    if (stop) break;
   }
-  free(indicies);
-  return JSON_ERR_KEY_INVALID;
+  json_free(tokens);
+  if (stats) {
+    stats->records = records;
+    stats->errors = errors;
+    stats->bytes = c - json;
+    stats->elapsed_us = json_time_us() - started;
+    double seconds = stats->elapsed_us ? stats->elapsed_us / 1e6 : 1e-6;
+    stats->records_per_second = records / seconds;
+    stats->bytes_per_second = stats->bytes / seconds;
+  }
+  return result != JSON_ERR_NONE ? result : records;
 }
 
 
+#if defined(JSON_ENABLE_THREADS)
 /**
- * Get the index of a key in a JSON object. The key may be the name or a dot delimited name path.
+ * Parse a large JSON document whose root is an array on a thread pool. A quote and depth
+ * aware pre-scan splits the root array between elements into chunks of about equal size,
+ * the chunks are tokenized concurrently with json_parse_elements_structural_grow and the chunk
+ * tokens are merged into one token array identical to the tokens from json_parse_tokens, with
+ * offsets corrected and the root size set. Documents smaller than JSON_PARALLEL_MIN_LENGTH,
+ * documents without a root array and chunks that do not parse are tokenized serially with
+ * json_parse_tokens_structural.
+ * NOTE: The caller is responsible for freeing the allocated memory for the tokens array with json_free.
  *
- * @param tokens The array of jsmntok_t tokens.
- * @param start_token The index of the starting token.
- * @param key The key to search for.
- * @param json The JSON string.
- * @return The index of the key if found, otherwise JSONErrorCode.
-*/
-int json_key_index (jsmntok_t *tokens, int start_token, char *key, char *json) {
-  int key_dot_index = 0; // token index for the key_dot key name
-  int dot_index = 0; // key string index of the dot delimiter
-  char *key_dot;
-  // loop until the end of the key string
-  do {
-    key_dot = json_get_key_dot(key, dot_index);
-    if (key_dot == NULL) {
-      // failed to extract the key name preceding the dot delimiter.
-      return JSON_ERR_KEY_INVALID;
+ * @param pool The pool from json_pool_create.
+ * @param json The JSON text, it does not need to be NUL terminated.
+ * @param length The length of the JSON text.
+ * @param tokens A pointer that will be set to the allocated token array.
+ * @return The number of tokens allocated into the tokens pointer, or JSONErrorCode on failure.
+ */
+int json_parse_array_parallel (json_pool_t *pool, const char *json, size_t length, json_token_t **tokens) {
+  if (!pool || !json || !tokens) return JSON_ERR_INVALID;
+  *tokens = NULL;
+  if (length > JSON_TOKEN_OFFSET_MAX) return JSON_ERR_RANGE;
+  const char *end = json + length;
+  const char *open = json_scan_space(json, end);
+  // bounded chunks balance the work between the workers
+  int chunk_limit = json_pool_size(pool) * JSON_PARALLEL_CHUNKS_PER_THREAD;
+  if (length / JSON_PARALLEL_CHUNK_LENGTH + 1 > (size_t)chunk_limit) chunk_limit = length / JSON_PARALLEL_CHUNK_LENGTH + 1;
+  json_document_t *chunks = NULL;
+  int chunk_count = 0;
+  int element_count = 0;
+  if (length >= JSON_PARALLEL_MIN_LENGTH && open < end && *open == '[') {
+    chunks = json_malloc(sizeof(json_document_t) * chunk_limit);
+  }
+  if (chunks != NULL) {
+    // split between elements once a chunk reaches its share of the text
+    size_t share = length / chunk_limit + 1;
+    const char *c = json_scan_space(open + 1, end);
+    const char *chunk_start = c;
+    int chunk_elements = 0;
+    bool valid = c < end && *c != ']';
+    while (valid) {
+      const char *element_end = json_skip_value(c, end);
+      if (element_end == NULL || element_end == c) {
+        valid = false;
+        break;
+      }
+      chunk_elements += 1;
+      c = json_scan_space(element_end, end);
+      bool last = c < end && *c == ']';
+      if (!last && (c >= end || *c != ',')) {
+        valid = false;
+        break;
+      }
+      if (last || ((size_t)(element_end - chunk_start) >= share && chunk_count < chunk_limit - 1)) {
+        json_document_t *chunk = &chunks[chunk_count++];
+        chunk->json = chunk_start;
+        chunk->length = element_end - chunk_start;
+        chunk->token_count = chunk_elements;               // expected root values until parsed
+        element_count += chunk_elements;
+        chunk_elements = 0;
+        if (last) break;
+        chunk_start = json_scan_space(c + 1, end);
+      }
+      c = json_scan_space(c + 1, end);
     }
-    dot_index += strlen(key_dot) + 1;
-    key_dot_index = json_root_key_index(tokens, key_dot_index, key_dot, json);
-    if (key_dot_index < 0) {
-      // failed to find a token index for the key_dot key name.
-      free(key_dot);
-      return JSON_ERR_KEY_INVALID;
+    // anything other than whitespace after the root array is left to jsmn
+    if (valid && json_scan_space(c + 1, end) != end) valid = false;
+    if (!valid) chunk_count = 0;
+  }
+
+  int token_count = 0;
+  if (chunk_count > 1) {
+    int *expected = json_malloc(sizeof(int) * chunk_count);
+    if (expected != NULL) {
+      for (int i = 0; i < chunk_count; i++) expected[i] = chunks[i].token_count;
+      token_count = json_pool_parse_with(pool, chunks, chunk_count, json_parse_elements_structural_grow, NULL, NULL) == chunk_count ? 1 : 0;
+      // each chunk must hold exactly the elements found by the pre-scan, the children of its root token
+      for (int i = 0; i < chunk_count && token_count > 0; i++) {
+        if (json_tok_size(&chunks[i].tokens[0]) != expected[i]) token_count = 0;
+        else token_count += chunks[i].token_count - 1;
+      }
+      json_free(expected);
+    }
+    // the root is built as a jsmn token and converted like the chunk tokens
+    jsmntok_t root;
+    json_token_t *packed = NULL;
+    memset(&root, 0, sizeof(root));
+    root.type = JSMN_ARRAY;
+    root.start = open - json;
+    root.end = (json_scan_space(chunks[chunk_count - 1].json + chunks[chunk_count - 1].length, end) - json) + 1;
+    root.size = element_count;
+    if (json_tokens_compact(&root, 1, &packed) != JSON_ERR_NONE) token_count = 0;
+    if (token_count > 0) *tokens = json_malloc(sizeof(json_token_t) * token_count);
+    if (*tokens != NULL) {
+      (*tokens)[0] = *packed;
+      int next = 1;
+      for (int i = 0; i < chunk_count; i++) {
+        int offset = chunks[i].json - json;
+        for (int j = 1; j < chunks[i].token_count; j++) {
+          // both token layouts name the offsets start and end
+          json_token_t *tok = &(*tokens)[next++];
+          *tok = chunks[i].tokens[j];
+          tok->start += offset;
+          tok->end += offset;
+        }
+      }
     }
-    // if not at end of key then increment key_dot_index by 1 for next iteration
-    if (dot_index < strlen(key)) key_dot_index += 1;
-    free(key_dot);
-  } while (dot_index < strlen(key));
-  return key_dot_index;
+    else token_count = 0;
+    for (int i = 0; i < chunk_count; i++) json_free(chunks[i].tokens);
+  }
+  json_free(chunks);
+  if (token_count > 0) return token_count;
+
+  // serial fallback
+  jsmn_parser parser;
+  return json_parse_tokens_structural(&parser, json, length, tokens);
 }
+#endif
 
 
 /**
  * Get the key string value preceding any dot delimiter.
- * NOTE: The caller is responsible for freeing the allocated memory.
+ * NOTE: The caller is responsible for freeing the allocated memory with json_free.
  *
  * @param key The full key string.
  * @param start_chr The starting character index.
- * @return The key string preceding the dot delimiter.
+ * @return The key string preceding the dot delimiter, or NULL on failure.
 */
 char * json_get_key_dot (const char *key, int start_chr) {
-  char *keydot;
-  char *c = ".";
-  const char *dot = strnstr(key + start_chr, c, strlen(key));
-  if (dot != NULL) {
-    keydot = strndup(key + start_chr, dot - key + start_chr);
-    return keydot;
-  }
-  else {
-    keydot = strndup(key + start_chr, strlen(key + start_chr));
-    return keydot;
-  }
-  return NULL;
+  const char *start = key + start_chr;
+  const char *dot = strchr(start, '.');
+  size_t length = dot != NULL ? (size_t)(dot - start) : strlen(start);
+  char *keydot = json_malloc(length + 1);
+  if (keydot == NULL) return NULL;
+  memcpy(keydot, start, length);
+  keydot[length] = '\0';
+  return keydot;
 }
 
 
@@ -497,13 +3394,11 @@ char * json_get_key_dot (const char *key, int start_chr) {
  * @param tok The jsmn token
  * @return JSON_KEY_MATCH if the keys match; otherwise, JSON_KEY_NO_MATCH.
  */
-int json_key_strcmp (const char *key, const char *json, jsmntok_t *tok) {
-  char *token_key = calloc(tok->end - tok->start + 1, sizeof(char));
-  strncpy(token_key, &json[tok->start], tok->end - tok->start);
+int json_key_strcmp (const char *key, const char *json, json_token_t *tok) {
 	if (
-    tok->type == JSMN_STRING && 
-    (int) strlen(key) == tok->end - tok->start &&
-    strncmp(json + tok->start, key, tok->end - tok->start) == 0
+    json_tok_type(tok) == JSMN_STRING && 
+    (int) strlen(key) == json_tok_end(tok) - json_tok_start(tok) &&
+    strncmp(json + json_tok_start(tok), key, json_tok_end(tok) - json_tok_start(tok)) == 0
   ) {
     return JSON_KEY_MATCH;
   }
@@ -513,6 +3408,55 @@ int json_key_strcmp (const char *key, const char *json, jsmntok_t *tok) {
 
 
 
+#if defined(JSON_ENABLE_STATS)
+// the counters are shared by all threads unless JSON_STATS_PER_THREAD is defined
+#if defined(JSON_STATS_PER_THREAD)
+JSON_THREAD_LOCAL json_stats_t json_stats_counters;
+#else
+json_stats_t json_stats_counters;
+#endif
+
+
+/**
+ * Get a snapshot of the hot path counters. Counters accumulate from the start of the
+ * program or the last json_stats_reset. Cycle counts come from the time stamp counter on
+ * x86, the virtual counter on arm64 and microseconds on the Pico.
+ * NOTE: With JSON_STATS_PER_THREAD the counters of the calling thread are returned.
+ *
+ * @param stats The stats to fill.
+ */
+void json_stats_get (json_stats_t *stats) {
+  if (!stats) return;
+#if defined(JSON_ENABLE_THREADS) && !defined(JSON_STATS_PER_THREAD)
+  // all counters are uint64_t, read each one atomically
+  const uint64_t *counters = (const uint64_t *)&json_stats_counters;
+  uint64_t *values = (uint64_t *)stats;
+  for (size_t i = 0; i < sizeof(json_stats_t) / sizeof(uint64_t); i++) {
+    values[i] = __atomic_load_n(&counters[i], __ATOMIC_RELAXED);
+  }
+#else
+  *stats = json_stats_counters;
+#endif
+}
+
+
+/**
+ * Reset the hot path counters to zero.
+ * NOTE: With JSON_STATS_PER_THREAD only the counters of the calling thread are reset.
+ */
+void json_stats_reset (void) {
+#if defined(JSON_ENABLE_THREADS) && !defined(JSON_STATS_PER_THREAD)
+  uint64_t *counters = (uint64_t *)&json_stats_counters;
+  for (size_t i = 0; i < sizeof(json_stats_t) / sizeof(uint64_t); i++) {
+    __atomic_store_n(&counters[i], 0, __ATOMIC_RELAXED);
+  }
+#else
+  memset(&json_stats_counters, 0, sizeof(json_stats_counters));
+#endif
+}
+#endif
+
+
 const char * json_error_string (JSONErrorCode result) {
     switch (result) {
         case JSON_ERR_NONE:
@@ -530,6 +3474,12 @@ const char * json_error_string (JSONErrorCode result) {
         case JSON_ERR_INDEX_INVALID:
             return "Invalid token index provided.";
 
+        case JSON_ERR_TRUNCATED:
+            return "Value truncated to fit the buffer.";
+
+        case JSON_ERR_RANGE:
+            return "Value out of range.";
+
         default:
             return "Unknown error code.";
     }
@@ -0,0 +1,1050 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "pico-json-reader.h"
+#if defined(JSON_WIDE_TOKENS) && defined(JSON_ENABLE_FILES)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define TEST_JSON_TOKEN_COUNT 25
+#define TEST_JSON "" \
+  "{\n" \
+  "  \"first\": 11,\n" \
+  "  \"test\": \"value\",\n" \
+  "  \"sub\": {\n" \
+  "    \"index\": 23,\n" \
+  "    \"title\": \"blah\"\n" \
+  "  },\n" \
+  "  \"array\": [1,2,3],\n" \
+  "  \"bool\": true,\n" \
+  "  \"float\": 1.23,\n" \
+  "  \"end\": [3,2,1]\n" \
+  "}"
+
+static int checks = 0;
+static int failures = 0;
+
+#define CHECK(condition) do { \
+    checks += 1; \
+    if (!(condition)) { \
+      failures += 1; \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+    } \
+  } while (0)
+
+
+// deterministic pseudo random numbers so failures reproduce
+static uint32_t random_state = 2463534242u;
+
+static uint32_t next_random (void) {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state;
+}
+
+
+static char * read_corpus (const char *name, size_t *length) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", JSON_CORPUS_DIR, name);
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) return NULL;
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  char *buffer = malloc(size + 1);
+  if (buffer != NULL && fread(buffer, 1, size, file) != (size_t)size) {
+    free(buffer);
+    buffer = NULL;
+  }
+  fclose(file);
+  if (buffer == NULL) return NULL;
+  buffer[size] = '\0';
+  *length = size;
+  return buffer;
+}
+
+
+// tokenize with jsmn only, the reference for the other tokenizers
+static int reference_tokens (const char *json, size_t length, json_token_t **tokens) {
+  jsmn_parser parser;
+  jsmntok_t *parsed = NULL;
+  unsigned int capacity = 0;
+  *tokens = NULL;
+  jsmn_init(&parser);
+  int count = json_parse_tokens_grow(&parser, json, length, &parsed, &capacity);
+  int err = count > 0 ? json_tokens_compact(parsed, count, tokens) : JSON_ERR_INVALID;
+  if (err != JSON_ERR_NONE) {
+    json_free(parsed);
+    *tokens = NULL;
+    return count < 0 ? count : err;
+  }
+  return count;
+}
+
+
+static bool same_tokens (const json_token_t *a, int a_count, const json_token_t *b, int b_count) {
+  if (a_count != b_count) return false;
+  return a_count <= 0 || memcmp(a, b, sizeof(json_token_t) * a_count) == 0;
+}
+
+
+// append a random JSON value to buffer
+static void random_value (char *buffer, size_t *length, int depth) {
+  static const char *strings[] = { "\"\"", "\"plain\"", "\"q\\\"uote\"", "\"back\\\\slash\"", "\"u\\u00e9\\ud83d\\ude00\"", "\"{[:,]}\"", "\"tab\\t\"" };
+  static const char *primitives[] = { "0", "-1", "12.5", "1e10", "-0.25E-3", "true", "false", "null", "123456789012" };
+  static const char *spaces[] = { "", " ", "\n", "\t", "\r\n  " };
+  *length += sprintf(buffer + *length, "%s", spaces[next_random() % 5]);
+  int kind = next_random() % (depth > 5 ? 2 : 4);
+  if (kind == 0) {
+    *length += sprintf(buffer + *length, "%s", strings[next_random() % 7]);
+  }
+  else if (kind == 1) {
+    *length += sprintf(buffer + *length, "%s", primitives[next_random() % 9]);
+  }
+  else {
+    bool object = kind == 3;
+    int count = next_random() % 5;
+    buffer[(*length)++] = object ? '{' : '[';
+    for (int i = 0; i < count; i++) {
+      if (i) buffer[(*length)++] = ',';
+      if (object) *length += sprintf(buffer + *length, "%s\"k%d\"%s:", spaces[next_random() % 5], (int)(next_random() % 4), spaces[next_random() % 5]);
+      random_value(buffer, length, depth + 1);
+    }
+    *length += sprintf(buffer + *length, "%s%c", spaces[next_random() % 5], object ? '}' : ']');
+  }
+  *length += sprintf(buffer + *length, "%s", spaces[next_random() % 5]);
+  buffer[*length] = '\0';
+}
+
+
+static void test_parse (void) {
+  jsmn_parser parser;
+  json_token_t *tokens = NULL;
+  jsmntok_t *parsed = NULL;
+  jsmntok_t fixed[8];
+  char *json = TEST_JSON;
+  size_t length = strlen(json);
+
+  CHECK(json_parse_tokens(&parser, json, &tokens) == TEST_JSON_TOKEN_COUNT);
+  json_free(tokens);
+  CHECK(json_estimate_token_count(json, length) >= TEST_JSON_TOKEN_COUNT);
+
+  // a fixed buffer that is too small can be continued with a larger one
+  jsmn_init(&parser);
+  CHECK(json_parse_tokens_into(&parser, json, length, fixed, 8) == JSMN_ERROR_NOMEM);
+  CHECK(parser.toknext == 8);
+
+  // every other failure is a JSONErrorCode, invalid JSON stops before the buffer is full
+  jsmn_init(&parser);
+  CHECK(json_parse_tokens_into(&parser, "[1}", 3, fixed, 8) == JSON_ERR_INVALID);
+  CHECK(parser.toknext < 8);
+  CHECK(json_parse_tokens_into(&parser, NULL, 0, fixed, 8) == JSON_ERR_INVALID);
+  CHECK(json_parse_tokens_into(&parser, json, length, NULL, 8) == JSON_ERR_INVALID);
+  CHECK(json_parse_tokens_into(&parser, json, (size_t)JSON_TOKEN_OFFSET_MAX + 1, fixed, 8) == JSON_ERR_RANGE);
+
+  unsigned int capacity = 1;
+  jsmn_init(&parser);
+  CHECK(json_parse_tokens_grow(&parser, json, length, &parsed, &capacity) == TEST_JSON_TOKEN_COUNT);
+  CHECK(capacity >= TEST_JSON_TOKEN_COUNT);
+  CHECK(json_tokens_compact(parsed, TEST_JSON_TOKEN_COUNT, &tokens) == JSON_ERR_NONE);
+  CHECK(json_tok_type(&tokens[0]) == JSMN_OBJECT && json_tok_size(&tokens[0]) == 7);
+  CHECK(json_tok_end(&tokens[0]) == (int)length);
+  json_free(parsed);
+
+  CHECK(json_parse_tokens(&parser, "{\"a\":", &tokens) < 0);
+  CHECK(tokens == NULL);
+
+  // a length explicit parse stops at the length, not at a NUL
+  const char *range = "[1,2][3,4,5]";
+  CHECK(json_parse_tokens_n(&parser, range, 5, &tokens) == 3);
+  CHECK(json_tok_end(&tokens[0]) == 5 && json_tok_size(&tokens[0]) == 2);
+  json_free(tokens);
+  CHECK(json_parse_tokens_n(&parser, range + 5, 7, &tokens) == 4);
+  json_free(tokens);
+  CHECK(json_parse_tokens_n(&parser, range, (size_t)JSON_TOKEN_OFFSET_MAX + 1, &tokens) == JSON_ERR_RANGE);
+  CHECK(json_parse_tokens_structural(&parser, range, (size_t)JSON_STRUCTURAL_OFFSET_MAX + 1, &tokens) == JSON_ERR_RANGE);
+  jsmn_init(&parser);
+  CHECK(json_parse_tokens_grow(&parser, range, (size_t)JSON_TOKEN_OFFSET_MAX + 1, &parsed, &capacity) == JSON_ERR_RANGE);
+}
+
+
+// the structural indexer must produce exactly the jsmn tokens
+static void test_structural (void) {
+  static const char *corpus[] = { "config.json", "sensors.json", "escapes.json", "nested.json" };
+  jsmn_parser parser;
+  for (int i = 0; i < 4; i++) {
+    size_t length = 0;
+    char *json = read_corpus(corpus[i], &length);
+    CHECK(json != NULL);
+    if (json == NULL) continue;
+    json_token_t *expected = NULL, *tokens = NULL;
+    int expected_count = reference_tokens(json, length, &expected);
+    int token_count = json_parse_tokens_structural(&parser, json, length, &tokens);
+    CHECK(expected_count > 0);
+    CHECK(same_tokens(expected, expected_count, tokens, token_count));
+    json_free(expected);
+    json_free(tokens);
+    free(json);
+  }
+
+  // random documents and random corruptions of them
+  char *json = malloc(1 << 16);
+  int mismatches = 0;
+  for (int i = 0; i < 20000; i++) {
+    size_t length = 0;
+    random_value(json, &length, 0);
+    if (i % 2) {
+      static const char corrupt[] = "{}[],:\"\\ a1\x01";
+      for (int k = 0; k < 2; k++) json[next_random() % length] = corrupt[next_random() % (sizeof(corrupt) - 1)];
+      if (i % 6 == 1) length = next_random() % length + 1;
+    }
+    json_token_t *expected = NULL, *tokens = NULL;
+    int expected_count = reference_tokens(json, length, &expected);
+    int token_count = json_parse_tokens_structural(&parser, json, length, &tokens);
+    if (!same_tokens(expected, expected_count, tokens, token_count)) mismatches += 1;
+    json_free(expected);
+    json_free(tokens);
+  }
+  CHECK(mismatches == 0);
+  free(json);
+
+  // array elements are parsed as the children of a root array token spanning them
+  const char *elements = " 1, {\"a\":[2]} ,\"x\" ";
+  jsmntok_t *parsed = NULL;
+  unsigned int capacity = 0;
+  CHECK(json_parse_elements_structural_grow(&parser, elements, strlen(elements), &parsed, &capacity) == 7);
+  CHECK(parsed[0].type == JSMN_ARRAY && parsed[0].size == 3 && parsed[0].start == 0 && parsed[0].end == (int)strlen(elements));
+  CHECK(parsed[2].type == JSMN_OBJECT && parsed[2].start == 4 && parsed[6].type == JSMN_STRING && parsed[6].size == 0);
+  static const char *invalid[] = { "", "1,", "1,2]", "1 2", "{\"a\":1" };
+  for (int i = 0; i < 5; i++) {
+    CHECK(json_parse_elements_structural_grow(&parser, invalid[i], strlen(invalid[i]), &parsed, &capacity) == JSON_ERR_INVALID);
+  }
+  json_free(parsed);
+}
+
+
+static void test_getters (void) {
+  jsmn_parser parser;
+  json_token_t *tokens = NULL;
+  char *json = TEST_JSON;
+  CHECK(json_parse_tokens(&parser, json, &tokens) == TEST_JSON_TOKEN_COUNT);
+
+  char *s = NULL;
+  CHECK(json_get_value_s("test", &s, json, tokens, 0) == JSON_ERR_NONE);
+  CHECK(s != NULL && strcmp(s, "value") == 0);
+  json_free(s);
+
+  json_string_view_t view;
+  CHECK(json_get_value_sv("sub.title", &view, json, tokens, 0) == JSON_ERR_NONE);
+  CHECK(view.len == 4 && strncmp(view.ptr, "blah", 4) == 0);
+
+  char buffer[4];
+  size_t length = 0;
+  CHECK(json_get_value_sn("test", buffer, sizeof(buffer), &length, json, tokens, 0) == JSON_ERR_TRUNCATED);
+  CHECK(strcmp(buffer, "val") == 0);
+
+  int i = 0;
+  CHECK(json_get_value_i("first", &i, json, tokens, 0) == JSON_ERR_NONE && i == 11);
+  CHECK(json_get_value_i("sub.index", &i, json, tokens, 0) == JSON_ERR_NONE && i == 23);
+  CHECK(json_get_value_i("float", &i, json, tokens, 0) == JSON_ERR_NONE && i == 1);
+  CHECK(json_get_value_i("missing", &i, json, tokens, 0) == JSON_ERR_KEY_INVALID);
+  CHECK(json_get_value_i("bool", &i, json, tokens, 0) == JSON_ERR_INVALID);
+
+  // int values truncate a fraction toward zero as atoi did, within the range of int
+  {
+    jsmn_parser truncate_parser;
+    json_token_t *truncate_tokens = NULL;
+    char truncate_json[] = "[-1.5,-0.5,2147483647.9,2147483648.5,1e400,25e-1]";
+    static const struct { int err; int value; } truncated[] = {
+      { JSON_ERR_NONE, -1 }, { JSON_ERR_NONE, 0 }, { JSON_ERR_NONE, INT_MAX },
+      { JSON_ERR_RANGE, 0 }, { JSON_ERR_RANGE, 0 }, { JSON_ERR_NONE, 2 },
+    };
+    CHECK(json_parse_tokens(&truncate_parser, truncate_json, &truncate_tokens) == 7);
+    for (int k = 0; k < 6; k++) {
+      int err = json_get_index_i(k + 1, &i, truncate_json, truncate_tokens);
+      CHECK(err == truncated[k].err && (err != JSON_ERR_NONE || i == truncated[k].value));
+    }
+    json_free(truncate_tokens);
+  }
+
+  int64_t i64 = 0;
+  uint64_t u64 = 0;
+  uint32_t u32 = 0;
+  CHECK(json_get_value_i64("first", &i64, json, tokens, 0) == JSON_ERR_NONE && i64 == 11);
+  CHECK(json_get_value_i64("float", &i64, json, tokens, 0) == JSON_ERR_INVALID);
+  CHECK(json_get_value_u64("first", &u64, json, tokens, 0) == JSON_ERR_NONE && u64 == 11);
+  CHECK(json_get_value_u32("sub.index", &u32, json, tokens, 0) == JSON_ERR_NONE && u32 == 23);
+
+  double d = 0;
+  float f = 0;
+  int64_t scaled = 0;
+  CHECK(json_get_value_d("float", &d, json, tokens, 0) == JSON_ERR_NONE && d == 1.23);
+  CHECK(json_get_value_f("float", &f, json, tokens, 0) == JSON_ERR_NONE && f == 1.23f);
+  CHECK(json_get_value_fixed("float", &scaled, 3, json, tokens, 0) == JSON_ERR_NONE && scaled == 1230);
+
+  bool b = false;
+  CHECK(json_get_value_b("bool", &b, json, tokens, 0) == JSON_ERR_NONE && b);
+  CHECK(json_get_value_b("first", &b, json, tokens, 0) == JSON_ERR_INVALID);
+
+  int32_t values[3];
+  CHECK(json_get_array_i32("array", values, 3, &length, json, tokens, 0) == JSON_ERR_NONE);
+  CHECK(length == 3 && values[0] == 1 && values[2] == 3);
+  CHECK(json_get_array_i32("end", values, 2, &length, json, tokens, 0) == JSON_ERR_TRUNCATED && length == 2);
+
+  json_free(tokens);
+}
+
+
+static void test_numbers (void) {
+  const char *text;
+  int64_t i64;
+  uint64_t u64;
+  double d;
+
+  text = "9223372036854775807";
+  CHECK(json_parse_int64(text, text + strlen(text), &i64) == JSON_ERR_NONE && i64 == INT64_MAX);
+  text = "-9223372036854775808";
+  CHECK(json_parse_int64(text, text + strlen(text), &i64) == JSON_ERR_NONE && i64 == INT64_MIN);
+  text = "9223372036854775808";
+  CHECK(json_parse_int64(text, text + strlen(text), &i64) == JSON_ERR_RANGE);
+  text = "18446744073709551615";
+  CHECK(json_parse_uint64(text, text + strlen(text), &u64) == JSON_ERR_NONE && u64 == UINT64_MAX);
+  text = "18446744073709551616";
+  CHECK(json_parse_uint64(text, text + strlen(text), &u64) == JSON_ERR_RANGE);
+  text = "12a";
+  CHECK(json_parse_int64(text, text + strlen(text), &i64) == JSON_ERR_INVALID);
+  text = "--5";
+  CHECK(json_parse_int64(text, text + strlen(text), &i64) == JSON_ERR_INVALID);
+
+  // integer valued fractions and exponents are integers, others are not
+  static const struct { const char *text; int err; int64_t value; } integral[] = {
+    { "1e3", JSON_ERR_NONE, 1000 }, { "-0.0", JSON_ERR_NONE, 0 }, { "1.0", JSON_ERR_NONE, 1 },
+    { "1.5e1", JSON_ERR_NONE, 15 }, { "-25E-1", JSON_ERR_INVALID, 0 }, { "1500e-2", JSON_ERR_NONE, 15 },
+    { "1550e-2", JSON_ERR_INVALID, 0 }, { "-1200E-2", JSON_ERR_NONE, -12 }, { "0e999999999", JSON_ERR_NONE, 0 },
+    { "1.5", JSON_ERR_INVALID, 0 }, { "1e-999999999", JSON_ERR_INVALID, 0 }, { "9.223372036854775807e18", JSON_ERR_NONE, INT64_MAX },
+    { "9.3e18", JSON_ERR_RANGE, 0 }, { "1e999999999", JSON_ERR_RANGE, 0 }, { "1.", JSON_ERR_INVALID, 0 },
+    { "1e", JSON_ERR_INVALID, 0 }, { ".5", JSON_ERR_INVALID, 0 }, { "1e3x", JSON_ERR_INVALID, 0 },
+  };
+  for (size_t i = 0; i < sizeof(integral) / sizeof(integral[0]); i++) {
+    text = integral[i].text;
+    i64 = -1;
+    int err = json_parse_int64(text, text + strlen(text), &i64);
+    CHECK(err == integral[i].err && (err != JSON_ERR_NONE || i64 == integral[i].value));
+  }
+  text = "-1e0";
+  CHECK(json_parse_uint64(text, text + strlen(text), &u64) == JSON_ERR_RANGE);
+  text = "1.8446744073709551615e19";
+  CHECK(json_parse_uint64(text, text + strlen(text), &u64) == JSON_ERR_NONE && u64 == UINT64_MAX);
+  text = "1.235";
+  CHECK(json_parse_fixed(text, text + strlen(text), &i64, 2) == JSON_ERR_NONE && i64 == 124);
+  text = "1e400";
+  CHECK(json_parse_double(text, text + strlen(text), &d) == JSON_ERR_RANGE);
+
+  // doubles must match a correctly rounded strtod
+  int mismatches = 0;
+  char number[64];
+  for (int i = 0; i < 20000; i++) {
+    int length;
+    switch (i % 4) {
+      case 0: length = sprintf(number, "%u.%u", next_random() % 100000, next_random() % 1000000); break;
+      case 1: length = sprintf(number, "-%ue%d", next_random(), (int)(next_random() % 40) - 20); break;
+      case 2: length = sprintf(number, "%.17g", (double)next_random() / (next_random() | 1)); break;
+      default: length = sprintf(number, "%u%u.%ue-%u", next_random(), next_random(), next_random(), next_random() % 300); break;
+    }
+    if (json_parse_double(number, number + length, &d) != JSON_ERR_NONE || d != strtod(number, NULL)) mismatches += 1;
+  }
+  CHECK(mismatches == 0);
+}
+
+
+static void test_unescape (void) {
+  size_t length = 0;
+  char *json = read_corpus("escapes.json", &length);
+  CHECK(json != NULL);
+  if (json == NULL) return;
+  jsmn_parser parser;
+  json_token_t *tokens = NULL;
+  CHECK(json_parse_tokens_structural(&parser, json, length, &tokens) > 0);
+
+  char buffer[64];
+  size_t out = 0;
+  CHECK(json_get_value_unescaped("quote", buffer, sizeof(buffer), &out, json, tokens, 0) == JSON_ERR_NONE);
+  CHECK(strcmp(buffer, "say \"hello\"") == 0);
+  CHECK(json_get_value_unescaped("path", buffer, sizeof(buffer), &out, json, tokens, 0) == JSON_ERR_NONE);
+  CHECK(strcmp(buffer, "C:\\temp\\file.txt") == 0);
+  CHECK(json_get_value_unescaped("unicode", buffer, sizeof(buffer), &out, json, tokens, 0) == JSON_ERR_NONE);
+  CHECK(strcmp(buffer, "caf\xc3\xa9 \xcf\x80 \xe2\x82\xac") == 0);
+  CHECK(json_get_value_unescaped("pair", buffer, sizeof(buffer), &out, json, tokens, 0) == JSON_ERR_NONE);
+  CHECK(strcmp(buffer, "\xf0\x9f\x98\x80 smile") == 0);
+  CHECK(json_get_value_unescaped("controls", buffer, 4, &out, json, tokens, 0) == JSON_ERR_TRUNCATED);
+  json_free(tokens);
+  free(json);
+
+  const char *invalid = "bad \\x escape";
+  CHECK(json_unescape(invalid, strlen(invalid), buffer, sizeof(buffer), &out) == JSON_ERR_INVALID);
+
+  // the vectorized decoder must match the scalar decoder
+  static const char *pieces[] = { "abcdefgh", "\\\"", "\\\\", "\\n", "\\u0041", "\\u00e9", "\\ud83d\\ude00", "\\/", "0123456789abcdefghijklmnopqrstuv" };
+  char src[512], fast[512], scalar[512];
+  int mismatches = 0;
+  for (int i = 0; i < 5000; i++) {
+    size_t src_length = 0;
+    int count = next_random() % 24;
+    for (int k = 0; k < count; k++) src_length += sprintf(src + src_length, "%s", pieces[next_random() % 9]);
+    size_t fast_length = 0, scalar_length = 0;
+    int fast_err = json_unescape(src, src_length, fast, sizeof(fast), &fast_length);
+    int scalar_err = json_unescape_scalar(src, src_length, scalar, sizeof(scalar), &scalar_length);
+    if (fast_err != scalar_err || fast_length != scalar_length || memcmp(fast, scalar, fast_length) != 0) mismatches += 1;
+  }
+  CHECK(mismatches == 0);
+}
+
+
+static void test_lookup (void) {
+  size_t length = 0;
+  char *json = read_corpus("config.json", &length);
+  CHECK(json != NULL);
+  if (json == NULL) return;
+  jsmn_parser parser;
+  json_token_t *tokens = NULL;
+  int token_count = json_parse_tokens_structural(&parser, json, length, &tokens);
+  CHECK(token_count > 0);
+
+  int index = json_key_index(tokens, 0, "thresholds.humidity.max", json);
+  int value = 0;
+  CHECK(index > 0 && json_get_index_i(index + 1, &value, json, tokens) == JSON_ERR_NONE && value == 85);
+  CHECK(json_key_index(tokens, 0, "thresholds.missing", json) == JSON_ERR_KEY_INVALID);
+  CHECK(json_root_key_index(tokens, 0, "mqtt", json) > 0);
+
+  // compiled paths, shape cache and token table give the same answers
+  json_path_t path;
+  CHECK(json_path_compile("mqtt.port", &path) == JSON_ERR_NONE);
+  CHECK(json_get_path_i(&path, &value, json, tokens, 0) == JSON_ERR_NONE && value == 1883);
+  json_shape_cache_t cache;
+  CHECK(json_shape_cache_init(&cache, &path, 1) == JSON_ERR_NONE);
+  int first = json_shape_key_index(&cache, 0, json, tokens, token_count);
+  CHECK(first == json_shape_key_index(&cache, 0, json, tokens, token_count) && cache.hits == 1);
+  CHECK(first == json_path_lookup(&path, json, tokens, 0));
+
+  json_token_table_t table;
+  CHECK(json_token_table_build(&table, tokens, token_count) == JSON_ERR_NONE);
+  table.hash_keys = true;
+  json_token_table_attach(&table);
+  CHECK(json_key_index(tokens, 0, "mqtt.port", json) == first);
+  CHECK(json_last_token_index(tokens, 0) == token_count - 1);
+  json_token_table_attach(NULL);
+  json_token_table_free(&table);
+
+  // tokens past the table, as after reparsing a longer document, walk the tokens
+  {
+    const char *small_json = "[[1,2],3]";
+    const char *large_json = "[[1,2],3,{\"k\":[4]}]";
+    json_token_t *small = NULL, *large = NULL;
+    int small_count = json_parse_tokens_structural(&parser, small_json, strlen(small_json), &small);
+    int large_count = json_parse_tokens_structural(&parser, large_json, strlen(large_json), &large);
+    CHECK(small_count == 5 && large_count == 9);
+    json_token_t *reused = json_malloc(sizeof(json_token_t) * large_count);
+    memcpy(reused, small, sizeof(json_token_t) * small_count);
+    CHECK(json_token_table_build(&table, reused, small_count) == JSON_ERR_NONE);
+    json_token_table_attach(&table);
+    memcpy(reused, large, sizeof(json_token_t) * large_count);
+    CHECK(json_last_token_index(reused, 5) == 8);
+    CHECK(json_last_object_token_index(reused, 5) == 8);
+    CHECK(json_last_array_token_index(reused, 7) == 8);
+    json_token_table_attach(NULL);
+    json_token_table_free(&table);
+    json_free(reused);
+    json_free(large);
+    json_free(small);
+  }
+
+  // key hash tables are bounds checked, kept when the table is attached again and freed with it
+  {
+    char forward_json[] = "{\"a\":1,\"b\":2,\"c\":3,\"d\":4,\"e\":5,\"f\":6,\"g\":7,\"h\":8}";
+    char reverse_json[] = "{\"h\":1,\"g\":2,\"f\":3,\"e\":4,\"d\":5,\"c\":6,\"b\":7,\"a\":8}";
+    char nested_json[] = "[0,{\"a\":1,\"b\":2,\"c\":3,\"d\":4,\"e\":5,\"f\":6,\"g\":7,\"h\":8}]";
+    json_token_t *forward = NULL, *reverse = NULL, *nested = NULL;
+    int forward_count = json_parse_tokens_structural(&parser, forward_json, strlen(forward_json), &forward);
+    int reverse_count = json_parse_tokens_structural(&parser, reverse_json, strlen(reverse_json), &reverse);
+    CHECK(forward_count == 17 && reverse_count == 17);
+    CHECK(json_token_table_build(&table, forward, forward_count) == JSON_ERR_NONE);
+    table.hash_keys = true;
+    json_token_table_attach(&table);
+    CHECK(json_key_index(forward, 0, "h", forward_json) == 15);
+    json_token_table_attach(&table);
+    CHECK(table.key_hashes != NULL && table.key_hashes[0] != NULL);
+    CHECK(json_key_index(forward, 0, "h", forward_json) == 15);
+    json_token_table_free(&table);
+    memcpy(forward, reverse, sizeof(json_token_t) * reverse_count);
+    CHECK(json_token_table_build(&table, forward, reverse_count) == JSON_ERR_NONE);
+    table.hash_keys = true;
+    json_token_table_attach(&table);
+    CHECK(json_key_index(forward, 0, "h", reverse_json) == 1);
+    json_token_table_attach(NULL);
+    json_token_table_free(&table);
+
+    json_token_t *single = NULL;
+    CHECK(json_parse_tokens_structural(&parser, "[0]", 3, &single) == 2);
+    CHECK(json_parse_tokens_structural(&parser, nested_json, strlen(nested_json), &nested) == 19);
+    json_token_t *reused = json_malloc(sizeof(json_token_t) * 19);
+    memcpy(reused, single, sizeof(json_token_t) * 2);
+    CHECK(json_token_table_build(&table, reused, 2) == JSON_ERR_NONE);
+    table.hash_keys = true;
+    json_token_table_attach(&table);
+    memcpy(reused, nested, sizeof(json_token_t) * 19);
+    CHECK(json_key_index(reused, 2, "h", nested_json) == 17);
+    json_token_table_attach(NULL);
+    json_token_table_free(&table);
+    json_free(reused);
+    json_free(single);
+    json_free(nested);
+    json_free(reverse);
+    json_free(forward);
+  }
+
+  // freeing or parsing into the token array detaches its table, an explicit table needs no attaching
+  {
+    char first_json[] = "{\"x\":[1,2,3],\"y\":1,\"z\":5}";
+    char second_json[] = "{\"x\":1,\"y\":[2,3,4],\"z\":5}";
+    json_token_t *first_tokens = NULL, *second_tokens = NULL;
+    int first_count = json_parse_tokens(&parser, first_json, &first_tokens);
+    CHECK(first_count == 10);
+    CHECK(json_token_table_build(&table, first_tokens, first_count) == JSON_ERR_NONE);
+    json_token_table_attach(&table);
+    json_free(first_tokens);
+    CHECK(json_parse_tokens(&parser, second_json, &second_tokens) == 10);
+    CHECK(json_key_index(second_tokens, 0, "y", second_json) == 3);
+    CHECK(json_key_index(second_tokens, 0, "z", second_json) == 8);
+    json_token_table_free(&table);
+
+    CHECK(json_token_table_build(&table, second_tokens, 10) == JSON_ERR_NONE);
+    table.hash_keys = true;
+    CHECK(json_table_key_index(&table, 0, "z", second_json) == 8);
+    CHECK(json_table_value_index(&table, 0, "y[2]", second_json) == 7);
+    CHECK(json_table_key_index(&table, 0, "w", second_json) == JSON_ERR_KEY_INVALID);
+    CHECK(json_table_key_index(&table, 10, "z", second_json) == JSON_ERR_INVALID);
+#if !defined(JSON_PACKED_TOKENS)
+    json_token_table_attach(&table);
+    jsmn_init(&parser);
+    CHECK(json_parse_tokens_into(&parser, first_json, strlen(first_json), second_tokens, 10) == 10);
+    CHECK(json_key_index(second_tokens, 0, "y", first_json) == 6);
+    json_token_table_attach(NULL);
+#endif
+    json_token_table_free(&table);
+    json_free(second_tokens);
+  }
+
+  // array subscripts and JSON Pointers step to the element in place
+  json_string_view_t topic;
+  index = json_key_index(tokens, 0, "schedule[2].seconds", json);
+  CHECK(index > 0 && json_get_index_i(index + 1, &value, json, tokens) == JSON_ERR_NONE && value == 90);
+  CHECK(json_key_index(tokens, 0, "/schedule/2/seconds", json) == index);
+  CHECK(json_get_value_i("schedule[1].zones[2]", &value, json, tokens, 0) == JSON_ERR_NONE && value == 3);
+  CHECK(json_get_value_i("/schedule/1/zones/2", &value, json, tokens, 0) == JSON_ERR_NONE && value == 3);
+  CHECK(json_get_value_sv("mqtt.topics[2]", &topic, json, tokens, 0) == JSON_ERR_NONE);
+  CHECK(topic.len == 12 && strncmp(topic.ptr, "control/vent", 12) == 0);
+  CHECK(json_key_index(tokens, 0, "mqtt.topics[2]", json) == JSON_ERR_KEY_INVALID);
+  CHECK(json_value_index(tokens, 0, "schedule", json) == json_key_index(tokens, 0, "schedule", json) + 1);
+  CHECK(json_value_index(tokens, 0, "schedule[3]", json) == JSON_ERR_KEY_INVALID);
+  CHECK(json_value_index(tokens, 0, "schedule[x]", json) == JSON_ERR_KEY_INVALID);
+  CHECK(json_value_index(tokens, 0, "schedule[01]", json) == JSON_ERR_KEY_INVALID);
+  CHECK(json_value_index(tokens, 0, "device[0]", json) == JSON_ERR_KEY_INVALID);
+  CHECK(json_value_index(tokens, 0, "/schedule/-", json) == JSON_ERR_KEY_INVALID);
+  int32_t zone_ids[4];
+  size_t zone_count = 0;
+  CHECK(json_get_array_i32("schedule[0].zones", zone_ids, 4, &zone_count, json, tokens, 0) == JSON_ERR_NONE);
+  CHECK(zone_count == 3 && zone_ids[2] == 3);
+
+  json_path_t element_paths[2];
+  CHECK(json_path_compile("/schedule/2/zones/0", &element_paths[0]) == JSON_ERR_NONE);
+  CHECK(json_path_compile("schedule[1].action", &element_paths[1]) == JSON_ERR_NONE);
+  CHECK(json_get_path_i(&element_paths[0], &value, json, tokens, 0) == JSON_ERR_NONE && value == 2);
+  CHECK(json_path_lookup(&element_paths[0], json, tokens, 0) == JSON_ERR_KEY_INVALID);
+  CHECK(json_path_compile("schedule[", &path) == JSON_ERR_KEY_INVALID);
+  CHECK(json_shape_cache_init(&cache, element_paths, 2) == JSON_ERR_NONE);
+  int action = json_shape_key_index(&cache, 1, json, tokens, token_count);
+  CHECK(action > 0 && action == json_shape_key_index(&cache, 1, json, tokens, token_count) && cache.hits == 1);
+  CHECK(action == json_key_index(tokens, 0, "/schedule/1/action", json));
+  CHECK(json_shape_key_index(&cache, 0, json, tokens, token_count) == JSON_ERR_KEY_INVALID);
+
+  // a cached key that moved into a nested object of the same span is a miss
+  {
+    const char *before = "{\"a\":{\"y\":1},\"b\":2}";
+    const char *after = "{\"a\":{\"q\":1,\"b\":3},\"b\":4}";
+    json_token_t *before_tokens = NULL, *after_tokens = NULL;
+    int before_count = json_parse_tokens_structural(&parser, before, strlen(before), &before_tokens);
+    int after_count = json_parse_tokens_structural(&parser, after, strlen(after), &after_tokens);
+    CHECK(json_path_compile("b", &path) == JSON_ERR_NONE);
+    CHECK(json_shape_cache_init(&cache, &path, 1) == JSON_ERR_NONE);
+    CHECK(json_shape_key_index(&cache, 0, before, before_tokens, before_count) == 5);
+    index = json_shape_key_index(&cache, 0, after, after_tokens, after_count);
+    CHECK(index == 7 && cache.hits == 0 && cache.misses == 2);
+    CHECK(json_get_index_i(index + 1, &value, after, after_tokens) == JSON_ERR_NONE && value == 4);
+    json_free(after_tokens);
+    json_free(before_tokens);
+  }
+
+  // a hit needs the same offsets, an element that moved is looked up again
+  {
+    const char *shapes[] = { "{\"x\":[{\"k\":1},{\"k\":2}]}", "{\"x\":[{\"k\":10},{\"k\":2}]}", "{\"x\":[{\"k\":11},{\"k\":3}]}" };
+    CHECK(json_path_compile("x[1].k", &path) == JSON_ERR_NONE);
+    CHECK(json_shape_cache_init(&cache, &path, 1) == JSON_ERR_NONE);
+    for (int i = 0; i < 3; i++) {
+      json_token_t *shape_tokens = NULL;
+      int shape_count = json_parse_tokens_structural(&parser, shapes[i], strlen(shapes[i]), &shape_tokens);
+      index = json_shape_key_index(&cache, 0, shapes[i], shape_tokens, shape_count);
+      CHECK(index == 7 && json_get_index_i(index + 1, &value, shapes[i], shape_tokens) == JSON_ERR_NONE && value == (i == 2 ? 3 : 2));
+      json_free(shape_tokens);
+    }
+    CHECK(cache.hits == 1 && cache.misses == 2);
+  }
+
+  // JSON Pointer key names escape '~' and '/'
+  const char *escaped = "{\"a/b\":{\"m~n\":[5,6]}}";
+  json_token_t *escaped_tokens = NULL;
+  CHECK(json_parse_tokens(&parser, (char *)escaped, &escaped_tokens) == 7);
+  CHECK(json_get_value_i("/a~1b/m~0n/1", &value, escaped, escaped_tokens, 0) == JSON_ERR_NONE && value == 6);
+  CHECK(json_path_compile("/a~1b/m~0n/0", &path) == JSON_ERR_NONE);
+  CHECK(json_get_path_i(&path, &value, escaped, escaped_tokens, 0) == JSON_ERR_NONE && value == 5);
+  CHECK(json_value_index(escaped_tokens, 0, "/a~2b", (char *)escaped) == JSON_ERR_KEY_INVALID);
+  json_free(escaped_tokens);
+
+  char *device = NULL;
+  bool enabled = false;
+  json_string_view_t ssid;
+  json_field_t fields[] = {
+    { "device.name", JSON_FIELD_STRING, &device, false, 0 },
+    { "device.enabled", JSON_FIELD_BOOL, &enabled, false, 0 },
+    { "wifi.ssid", JSON_FIELD_VIEW, &ssid, false, 0 },
+    { "wifi.missing", JSON_FIELD_INT, &value, false, 0 },
+    { "schedule[0].seconds", JSON_FIELD_INT, &value, false, 0 },
+    { "/wifi/ssid", JSON_FIELD_VIEW, &ssid, false, 0 }
+  };
+  uint64_t elapsed_us = UINT64_MAX;
+  CHECK(json_get_fields(fields, 6, json, tokens, 0, &elapsed_us) == 3);
+  CHECK(elapsed_us < 1000000);
+  CHECK(device != NULL && strcmp(device, "greenhouse-controller") == 0 && enabled);
+  CHECK(ssid.len == 10 && strncmp(ssid.ptr, "greenhouse", 10) == 0);
+  CHECK(fields[3].status == JSON_ERR_KEY_INVALID);
+  CHECK(!fields[4].found && fields[4].status == JSON_ERR_INVALID);
+  CHECK(!fields[5].found && fields[5].status == JSON_ERR_INVALID);
+  json_free(device);
+
+  // scanning the raw text finds the same values as the token lookup
+  static const char *keys[] = { "device.id", "mqtt.topics", "thresholds.soil", "schedule", "wifi.static" };
+  for (int i = 0; i < 5; i++) {
+    json_string_view_t view;
+    int key = json_key_index(tokens, 0, (char *)keys[i], json);
+    int type = json_scan_value(json, length, keys[i], &view);
+    json_token_t *tok = &tokens[key + 1];
+    CHECK(key > 0 && type == (int)json_tok_type(tok));
+    CHECK(view.ptr == json + json_tok_start(tok) && view.len == (size_t)(json_tok_end(tok) - json_tok_start(tok)));
+  }
+
+  // iterate the schedule entries in place
+  json_iter_t it;
+  int key_token, value_token, entries = 0, zones = 0;
+  index = json_key_index(tokens, 0, "schedule", json);
+  CHECK(json_iter_begin(&it, tokens, index + 1) == JSON_ERR_NONE);
+  while (json_iter_next(&it, &key_token, &value_token) == 1) {
+    int32_t zone[4];
+    size_t count = 0;
+    CHECK(key_token == -1 && json_tok_type(&tokens[value_token]) == JSMN_OBJECT);
+    CHECK(json_get_array_i32("zones", zone, 4, &count, json, tokens, value_token) == JSON_ERR_NONE);
+    zones += count;
+    entries += 1;
+  }
+  CHECK(entries == 3 && zones == 7);
+
+  int *indices = NULL;
+  CHECK(json_root_object_indicies(tokens, 0, &indices) == 5);
+  json_free(indices);
+  json_free(tokens);
+  free(json);
+}
+
+
+// selected tokens answer the selected lookups like the full token array
+static void test_selected (void) {
+  size_t length = 0;
+  char *json = read_corpus("config.json", &length);
+  CHECK(json != NULL);
+  if (json == NULL) return;
+  jsmn_parser parser;
+  json_token_t *full = NULL;
+  json_token_t *tokens = NULL;
+  int full_count = json_parse_tokens_n(&parser, json, length, &full);
+
+  json_path_t paths[4];
+  CHECK(json_path_compile("mqtt.port", &paths[0]) == JSON_ERR_NONE);
+  CHECK(json_path_compile("/schedule/1/zones", &paths[1]) == JSON_ERR_NONE);
+  CHECK(json_path_compile("thresholds.humidity", &paths[2]) == JSON_ERR_NONE);
+  CHECK(json_path_compile("schedule[2].seconds", &paths[3]) == JSON_ERR_NONE);
+  int token_count = json_parse_tokens_selected(paths, 4, json, length, &tokens);
+  CHECK(token_count > 0 && token_count < full_count / 2);
+
+  int value = 0;
+  int32_t zones[4];
+  size_t count = 0;
+  CHECK(json_get_value_i("mqtt.port", &value, json, tokens, 0) == JSON_ERR_NONE && value == 1883);
+  CHECK(json_get_value_i("thresholds.humidity.max", &value, json, tokens, 0) == JSON_ERR_NONE && value == 85);
+  CHECK(json_get_value_i("schedule[2].seconds", &value, json, tokens, 0) == JSON_ERR_NONE && value == 90);
+  CHECK(json_get_array_i32("schedule[1].zones", zones, 4, &count, json, tokens, 0) == JSON_ERR_NONE && count == 3);
+  CHECK(json_get_value_i("mqtt.qos", &value, json, tokens, 0) == JSON_ERR_KEY_INVALID);
+  CHECK(json_get_value_i("device.id", &value, json, tokens, 0) == JSON_ERR_KEY_INVALID);
+  CHECK(json_last_token_index(tokens, 0) == token_count - 1);
+
+  // a selected subtree has exactly the tokens of the full parse
+  int selected = json_value_index(tokens, 0, "thresholds.humidity", json);
+  int original = json_value_index(full, 0, "thresholds.humidity", json);
+  CHECK(selected > 0 && original > 0 && same_tokens(&tokens[selected], 5, &full[original], 5));
+  // the schedule keeps stub tokens for the elements before the selected ones
+  int schedule = json_value_index(tokens, 0, "schedule", json);
+  CHECK(json_tok_size(&tokens[schedule]) == 3 && json_tok_size(&tokens[schedule + 1]) == 0);
+  CHECK(json_tok_start(&tokens[schedule + 1]) == json_tok_start(&full[json_value_index(full, 0, "schedule[0]", json)]));
+  json_free(tokens);
+
+  CHECK(json_parse_tokens_selected(paths, 1, "{\"mqtt\":{\"port\":", 17, &tokens) == JSON_ERR_INVALID && tokens == NULL);
+  CHECK(json_parse_tokens_selected(paths, 1, "[1,2]", 5, &tokens) == 1);
+  json_free(tokens);
+  json_free(full);
+  free(json);
+}
+
+
+static int count_record (const char *json, size_t length, json_token_t *tokens, int token_count, void *context) {
+  int id = -1;
+  (void)length;
+  (void)token_count;
+  if (json_get_value_i("id", &id, json, tokens, 0) == JSON_ERR_NONE) *(int *)context += id;
+  return 0;
+}
+
+
+static void test_records (void) {
+  size_t length = 0;
+  char *json = read_corpus("records.ndjson", &length);
+  CHECK(json != NULL);
+  if (json == NULL) return;
+
+  int sum = 0;
+  json_batch_stats_t stats;
+  CHECK(json_parse_batch(json, length, count_record, &sum, &stats) == 50);
+  CHECK(sum == 49 * 50 / 2 && stats.errors == 0 && stats.bytes == length);
+
+  // feeding the first record in random sized chunks completes it
+  const char *newline = memchr(json, '\n', length);
+  json_stream_t stream;
+  CHECK(json_stream_init(&stream) == JSON_ERR_NONE);
+  int result = JSON_STREAM_NEED_MORE;
+  for (const char *c = json; c < newline && result == JSON_STREAM_NEED_MORE; ) {
+    size_t chunk = next_random() % 7 + 1;
+    if (chunk > (size_t)(newline - c)) chunk = newline - c;
+    result = json_feed(&stream, c, chunk);
+    c += chunk;
+  }
+  int id = -1;
+  CHECK(result == JSON_STREAM_COMPLETE);
+  CHECK(json_get_value_i("id", &id, stream.buffer, stream.tokens, 0) == JSON_ERR_NONE && id == 0);
+  json_stream_free(&stream);
+  free(json);
+}
+
+
+#if defined(JSON_ENABLE_FILES)
+// mapped files are parsed in place and match the heap copy
+static void test_files (void) {
+  char path[512];
+  size_t length = 0;
+  char *json = read_corpus("sensors.json", &length);
+  CHECK(json != NULL);
+  if (json == NULL) return;
+
+  json_file_t file;
+  json_token_t *expected = NULL;
+  int expected_count = reference_tokens(json, length, &expected);
+  snprintf(path, sizeof(path), "%s/%s", JSON_CORPUS_DIR, "sensors.json");
+  CHECK(json_open_file(path, &file) == expected_count);
+  CHECK(file.length == length && memcmp(file.json, json, length) == 0);
+  CHECK(same_tokens(file.tokens, file.token_count, expected, expected_count));
+  json_close_file(&file);
+  CHECK(file.json == NULL && file.tokens == NULL);
+  json_free(expected);
+  free(json);
+
+  // the records are parsed straight out of the mapping
+  int sum = 0;
+  snprintf(path, sizeof(path), "%s/%s", JSON_CORPUS_DIR, "records.ndjson");
+  CHECK(json_map_file(path, &file) == JSON_ERR_NONE && file.tokens == NULL);
+  CHECK(json_parse_batch(file.json, file.length, count_record, &sum, NULL) == 50);
+  CHECK(sum == 49 * 50 / 2);
+  json_close_file(&file);
+
+  CHECK(json_open_file(JSON_CORPUS_DIR "/missing.json", &file) == JSON_ERR_INVALID);
+  CHECK(json_open_file(JSON_CORPUS_DIR, &file) == JSON_ERR_INVALID);
+}
+#endif
+
+
+static void test_arena (void) {
+  static unsigned char memory[4096];
+  json_arena_t arena;
+  json_allocator_t allocator;
+  json_arena_init(&arena, &allocator, memory, sizeof(memory));
+  json_set_allocator(&allocator);
+  jsmn_parser parser;
+  json_token_t *tokens = NULL;
+  char *value = NULL;
+  CHECK(json_parse_tokens(&parser, TEST_JSON, &tokens) == TEST_JSON_TOKEN_COUNT);
+  CHECK(json_get_value_s("sub.title", &value, TEST_JSON, tokens, 0) == JSON_ERR_NONE);
+  CHECK((unsigned char *)tokens >= memory && (unsigned char *)value < memory + sizeof(memory));
+  json_arena_reset(&arena);
+  CHECK(arena.used == 0);
+  json_set_allocator(NULL);
+}
+
+
+#if defined(JSON_COMPACT_TOKENS)
+static void test_compact (void) {
+  jsmn_parser parser;
+  json_token_t *tokens = NULL;
+  CHECK(sizeof(json_token_t) * 8 == 3 * JSON_COMPACT_TOKENS);
+  CHECK(json_parse_tokens(&parser, TEST_JSON, &tokens) == TEST_JSON_TOKEN_COUNT);
+  json_free(tokens);
+
+  // more elements than the packed child count holds
+  size_t count = JSON_TOKEN_SIZE_MAX < 100000 ? JSON_TOKEN_SIZE_MAX + 1 : 0;
+  if (count) {
+    char *json = malloc(count * 2 + 2);
+    size_t length = 0;
+    json[length++] = '[';
+    for (size_t i = 0; i < count; i++) {
+      json[length++] = '0';
+      json[length++] = ',';
+    }
+    json[length - 1] = ']';
+    json[length] = '\0';
+    CHECK(json_parse_tokens(&parser, json, &tokens) == JSON_ERR_RANGE && tokens == NULL);
+    CHECK(json_parse_tokens_structural(&parser, json, length, &tokens) == JSON_ERR_RANGE && tokens == NULL);
+    free(json);
+  }
+}
+#endif
+
+
+#if defined(JSON_WIDE_TOKENS)
+#if defined(JSON_ENABLE_FILES)
+// a document crossing 2 GB in a file created sparse, the region up to the tail must still be
+// written with whitespace because a hole reads as NUL characters and a NUL ends the document,
+// so the 2 GB write only runs when JSON_TEST_LARGE_FILES is set in the environment
+static void test_wide_file (void) {
+  if (getenv("JSON_TEST_LARGE_FILES") == NULL) {
+    printf("skipped the 2 GB file test, set JSON_TEST_LARGE_FILES to run it\n");
+    return;
+  }
+  int value = 0;
+  const char *tmp = getenv("TMPDIR");
+  char path[512];
+  snprintf(path, sizeof(path), "%s/pico-json-reader-XXXXXX", tmp ? tmp : "/tmp");
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    printf("skipped the 2 GB file test, no temporary file\n");
+    return;
+  }
+  static const char head[] = "{\"head\":1,";
+  static const char tail[] = "\"tail\":7}";
+  off_t tail_offset = (off_t)1 << 31;
+  bool written = ftruncate(fd, tail_offset + 4096) == 0 &&
+    pwrite(fd, head, sizeof(head) - 1, 0) == (ssize_t)(sizeof(head) - 1);
+  char *spaces = malloc(1 << 20);
+  if (spaces != NULL) memset(spaces, ' ', 1 << 20);
+  for (off_t offset = sizeof(head) - 1; written && offset < tail_offset; ) {
+    size_t block = tail_offset - offset < (1 << 20) ? (size_t)(tail_offset - offset) : (1 << 20);
+    written = spaces != NULL && pwrite(fd, spaces, block, offset) == (ssize_t)block;
+    offset += block;
+  }
+  free(spaces);
+  written = written && pwrite(fd, tail, sizeof(tail) - 1, tail_offset) == (ssize_t)(sizeof(tail) - 1);
+  close(fd);
+  if (!written) {
+    printf("skipped the 2 GB file test, the file could not be written\n");
+    unlink(path);
+    return;
+  }
+
+  json_file_t file;
+  CHECK(json_open_file(path, &file) == 5);
+  if (file.tokens != NULL) {
+    CHECK(json_tok_end(&file.tokens[0]) == tail_offset + (off_t)sizeof(tail) - 1);
+    CHECK(json_tok_start(&file.tokens[3]) == tail_offset + 1 && json_tok_start(&file.tokens[3]) > INT_MAX);
+    value = 0;
+    CHECK(json_get_value_i("tail", &value, file.json, file.tokens, 0) == JSON_ERR_NONE && value == 7);
+    CHECK(json_get_value_i("head", &value, file.json, file.tokens, 0) == JSON_ERR_NONE && value == 1);
+  }
+  json_close_file(&file);
+  unlink(path);
+}
+#endif
+
+
+static void test_wide (void) {
+  jsmn_parser parser;
+  json_token_t *tokens = NULL;
+  CHECK(sizeof(json_token_t) == 16);
+  CHECK(json_parse_tokens(&parser, TEST_JSON, &tokens) == TEST_JSON_TOKEN_COUNT);
+  json_free(tokens);
+  CHECK(json_parse_tokens_structural(&parser, TEST_JSON, strlen(TEST_JSON), &tokens) == TEST_JSON_TOKEN_COUNT);
+  int value = 0;
+  CHECK(json_get_value_i("sub.index", &value, TEST_JSON, tokens, 0) == JSON_ERR_NONE && value == 23);
+  json_free(tokens);
+
+  // 48 bit offsets round trip through the accessors
+  json_token_t wide;
+  int64_t start = ((int64_t)0x1234 << 32) | 0x89abcdef;
+  int64_t end = ((int64_t)0xfffe << 32) | 0xffffffff;
+  wide.start = (json_token_word_t)start;
+  wide.start_high = (uint16_t)(start >> 32);
+  wide.size_type = (json_token_word_t)JSON_TOKEN_SIZE_MAX | (json_token_word_t)2 << JSON_TOKEN_TYPE_SHIFT;
+  json_tok_set_end(&wide, end);
+  CHECK(json_tok_start(&wide) == start && json_tok_end(&wide) == end);
+  CHECK(json_tok_end(&wide) - json_tok_start(&wide) == end - start && json_tok_start(&wide) > INT_MAX);
+  CHECK(json_tok_type(&wide) == JSMN_STRING && json_tok_size(&wide) == (int)JSON_TOKEN_SIZE_MAX);
+  json_tok_set_end(&wide, 5);
+  CHECK(json_tok_end(&wide) == 5 && json_tok_start(&wide) == start);
+
+  // jsmn tokens up to INT_MAX are packed with clear high words
+  jsmntok_t narrow[2] = { { JSMN_ARRAY, 0, INT_MAX, 1 }, { JSMN_PRIMITIVE, INT_MAX - 2, INT_MAX - 1, 0 } };
+  json_token_t *packed = NULL;
+  CHECK(json_tokens_compact(narrow, 2, &packed) == JSON_ERR_NONE);
+  CHECK(json_tok_end(&packed[0]) == INT_MAX && json_tok_start(&packed[1]) == INT_MAX - 2);
+  CHECK(json_tok_type(&packed[0]) == JSMN_ARRAY && json_tok_size(&packed[0]) == 1 && json_tok_type(&packed[1]) == JSMN_PRIMITIVE);
+
+#if defined(JSON_ENABLE_FILES)
+  test_wide_file();
+#endif
+}
+#endif
+
+
+#if defined(JSON_ENABLE_STATS)
+static void test_stats (void) {
+  jsmn_parser parser;
+  json_token_t *tokens = NULL;
+  json_stats_t stats;
+  json_stats_reset();
+  json_stats_get(&stats);
+  CHECK(stats.parses == 0 && stats.allocations == 0 && stats.lookups == 0);
+
+  CHECK(json_parse_tokens(&parser, TEST_JSON, &tokens) == TEST_JSON_TOKEN_COUNT);
+  json_stats_get(&stats);
+  CHECK(stats.parses == 1 && stats.allocations >= 1);
+  CHECK(stats.allocated_bytes >= sizeof(jsmntok_t) * TEST_JSON_TOKEN_COUNT);
+
+  // the last key is found after comparing every key and stepping over the sub object and array
+  json_stats_reset();
+  char *value = NULL;
+  CHECK(json_get_value_s("test", &value, TEST_JSON, tokens, 0) == JSON_ERR_NONE);
+  int index = json_key_index(tokens, 0, "end", TEST_JSON);
+  CHECK(index > 0);
+  json_stats_get(&stats);
+  CHECK(stats.lookups == 2 && stats.copied_bytes == 5);
+  CHECK(stats.key_compares == 2 + 7 && stats.tokens_scanned == 2 + 7 + 4 + 3);
+  json_free(value);
+
+  json_iter_t it;
+  json_stats_reset();
+  CHECK(json_iter_begin(&it, tokens, 0) == JSON_ERR_NONE);
+  while (json_iter_next(&it, NULL, NULL) == 1);
+  json_stats_get(&stats);
+  CHECK(stats.tokens_scanned >= 14);
+  json_free(tokens);
+}
+#endif
+
+
+#if defined(JSON_ENABLE_THREADS)
+static int check_document (const char *json, size_t length, json_token_t *tokens, int token_count, void *context) {
+  int value = 0;
+  (void)length;
+  (void)token_count;
+  (void)context;
+  return json_get_value_i("sub.index", &value, json, tokens, 0) == JSON_ERR_NONE ? value : -1;
+}
+
+
+static void test_threads (void) {
+  json_pool_t *pool = json_pool_create(4);
+  CHECK(pool != NULL);
+  if (pool == NULL) return;
+
+  json_document_t documents[64];
+  for (int i = 0; i < 64; i++) {
+    documents[i].json = i % 9 ? TEST_JSON : "{\"broken\":";
+    documents[i].length = strlen(documents[i].json);
+  }
+  CHECK(json_pool_parse(pool, documents, 64, NULL, NULL) == 56);
+  for (int i = 0; i < 64; i++) {
+    CHECK(i % 9 ? documents[i].token_count == TEST_JSON_TOKEN_COUNT : documents[i].token_count < 0);
+    json_free(documents[i].tokens);
+  }
+  CHECK(json_pool_parse(pool, documents, 64, check_document, NULL) == 56);
+  CHECK(documents[1].status == 23);
+  CHECK(json_pool_parse_with(pool, documents, 64, json_parse_tokens_grow, check_document, NULL) == 56);
+  CHECK(documents[1].status == 23);
+
+  // a large root array split over the pool matches the serial tokens
+  size_t capacity = 4 << 20, length = 0;
+  char *json = malloc(capacity);
+  length += sprintf(json, "[");
+  for (int i = 0; length < capacity - 1024; i++) {
+    if (i) json[length++] = ',';
+    random_value(json, &length, 1);
+  }
+  json[length++] = ']';
+  json_token_t *expected = NULL, *tokens = NULL;
+  int token_count = json_parse_array_parallel(pool, json, length, &tokens);
+  int expected_count = reference_tokens(json, length, &expected);
+#if JSON_COMPACT_TOKENS == 16
+  CHECK(token_count == JSON_ERR_RANGE && expected_count == JSON_ERR_RANGE);
+#else
+  CHECK(token_count > 0 && same_tokens(expected, expected_count, tokens, token_count));
+#endif
+  json_free(expected);
+  json_free(tokens);
+  free(json);
+  json_pool_free(pool);
+}
+#endif
+
+
+int main (void) {
+  test_parse();
+  test_structural();
+  test_getters();
+  test_numbers();
+  test_unescape();
+  test_lookup();
+  test_selected();
+  test_records();
+  test_arena();
+#if defined(JSON_ENABLE_FILES)
+  test_files();
+#endif
+#if defined(JSON_COMPACT_TOKENS)
+  test_compact();
+#endif
+#if defined(JSON_WIDE_TOKENS)
+  test_wide();
+#endif
+#if defined(JSON_ENABLE_STATS)
+  test_stats();
+#endif
+#if defined(JSON_ENABLE_THREADS)
+  test_threads();
+#endif
+  printf("%d checks, %d failed\n", checks, failures);
+  return failures ? 1 : 0;
+}